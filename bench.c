@@ -0,0 +1,507 @@
+/*
+ * bench.c
+ * Headless benchmarks, run with "make bench".
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <curses.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drtron.h"
+
+//Benchmark arena and how much of it to play
+#define BENCH_WIDTH 160
+#define BENCH_HEIGHT 60
+#define BENCH_GAMES 50
+#define BENCH_MAX_TICKS 20000
+//Frames each render backend draws
+#define BENCH_FRAMES 2000
+//Games played against external bots
+#define BENCH_BOT_GAMES 10
+//Sharded arena: size, players and ticks played
+#define BENCH_ARENA_WIDTH 2000
+#define BENCH_ARENA_HEIGHT 1200
+#define BENCH_ARENA_PLS 2000
+#define BENCH_ARENA_TICKS 2000
+//Sealed games played out: an arena sized case to go with the small ones
+#define BENCH_SEALED_PLS 200
+#define BENCH_SEALED_WIDTH 400
+#define BENCH_SEALED_HEIGHT 300
+#define BENCH_SEALED_GAMES 2
+//Best of this many rounds is reported, to keep noise out
+#define BENCH_ROUNDS 7
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Play BENCH_GAMES autopiloted games. */
+/* CLASSIC maps are all floor whatever the seed, so each game is a size smaller than the last to make them differ. */
+/* Only time spent in the tick is counted. */
+static void bench_games(settings_t *settings, unsigned long *ticks, long long *ns)
+{
+    int g, i;
+    game_t game;
+    bool over;
+    long long start;
+
+    *ticks = 0;
+    *ns = 0;
+    for (g=0; g < BENCH_GAMES; g++)
+    {
+        settings->seed = g + 1;
+        game_init(&game, settings, BENCH_WIDTH - g, BENCH_HEIGHT - g / 2);
+        do
+        {
+            for (i=0; i < game.num_players; i++)
+            {
+                game_autopilot(&game, i);
+            }
+            start = now_ns();
+            over = game_tick(&game);
+            *ns += now_ns() - start;
+        } while (!over && game.tick < BENCH_MAX_TICKS);
+        *ticks += game.tick;
+        cleanup_game(&game);
+    }
+}
+
+/* Time a tick in each mode and player count. */
+static void bench_ticks(void)
+{
+    int i, n, r;
+    settings_t settings;
+    const int modes[] = { CLASSIC, WORM, DECAY };
+    const char *mode_names[] = { [CLASSIC] = "classic", [WORM] = "worm", [DECAY] = "decay" };
+    unsigned long ticks;
+    long long best_ns, ns;
+
+    default_settings(&settings, CLASSIC, 0);
+
+    printf("ticks: best of %d rounds of %d games from %dx%d down to %dx%d, autopiloted\n", BENCH_ROUNDS, BENCH_GAMES,
+           BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH - BENCH_GAMES + 1, BENCH_HEIGHT - (BENCH_GAMES - 1) / 2);
+    printf("%-8s %7s %8s %10s\n", "mode", "players", "ticks", "ns/tick");
+    for (i=0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        settings.gamemode = modes[i];
+        for (n=MIN_PLS; n <= MAX_PLS; n++)
+        {
+            settings.num_pls = n;
+            best_ns = -1;
+            for (r=0; r < BENCH_ROUNDS; r++)
+            {
+                bench_games(&settings, &ticks, &ns);
+                best_ns = (best_ns < 0 || ns < best_ns) ? ns : best_ns;
+            }
+            printf("%-8s %7d %8lu %10.1f\n", mode_names[modes[i]], n, ticks, (double) best_ns / ticks);
+        }
+    }
+
+    cleanup_settings(&settings);
+}
+
+/* Bytes and write syscalls this process has made so far. */
+/* RETURN: false if the kernel does not keep count. */
+static bool io_counts(long long *bytes, long long *calls)
+{
+    FILE *io;
+    char line[64];
+    int found = 0;
+
+    io = fopen("/proc/self/io", "r");
+    if (io == NULL)
+    {
+        return false;
+    }
+    while (fgets(line, sizeof(line), io) != NULL)
+    {
+        found += sscanf(line, "wchar: %lld", bytes);
+        found += sscanf(line, "syscw: %lld", calls);
+    }
+    fclose(io);
+    return found == 2;
+}
+
+/* Draw an autopiloted worm game with backend, writing to out. */
+static void bench_backend(const render_t *backend, settings_t *settings, FILE *out)
+{
+    int i;
+    game_t game;
+    frame_t frame;
+    int frames = 0;
+    bool over = false;
+    long long start, ns;
+    long long bytes, calls, end_bytes, end_calls;
+    bool counted;
+
+    settings->seed = 1;
+    game_init(&game, settings, BENCH_WIDTH, BENCH_HEIGHT);
+    frame.cells = (cell_t *) malloc(BENCH_WIDTH * BENCH_HEIGHT * sizeof(cell_t));
+    backend->begin(fileno(out), BENCH_WIDTH, BENCH_HEIGHT);
+
+    counted = io_counts(&bytes, &calls);
+    start = now_ns();
+    while (!over && frames < BENCH_FRAMES)
+    {
+        for (i=0; i < game.num_players; i++)
+        {
+            game_autopilot(&game, i);
+        }
+        over = game_tick(&game);
+        game_snapshot(&game, &frame);
+        backend->draw(&frame);
+        frames++;
+    }
+    fflush(out);
+    ns = now_ns() - start;
+    counted = counted && io_counts(&end_bytes, &end_calls);
+
+    if (counted)
+    {
+        printf("%-8s %7d %12.1f %12.2f %12.1f\n", backend->name, frames,
+               (double) (end_bytes - bytes) / frames, (double) (end_calls - calls) / frames, ns / 1000.0 / frames);
+    }
+    else
+    {
+        printf("%-8s %7d %12s %12s %12.1f\n", backend->name, frames, "?", "?", ns / 1000.0 / frames);
+    }
+
+    backend->end();
+    free(frame.cells);
+    cleanup_game(&game);
+}
+
+/* Compare what each render backend costs per frame. */
+static int bench_render(void)
+{
+    int i;
+    settings_t settings;
+    /* Frames go nowhere; the terminal is only pretend. */
+    FILE *out, *in;
+    SCREEN *screen;
+    const char *term = getenv("TERM");
+    char dim[16];
+
+    default_settings(&settings, WORM, MAX_PLS);
+
+    out = fopen("/dev/null", "w");
+    in = fopen("/dev/null", "r");
+    /* Curses can't ask /dev/null how big it is. */
+    snprintf(dim, sizeof(dim), "%d", BENCH_HEIGHT + 1);
+    setenv("LINES", dim, 1);
+    snprintf(dim, sizeof(dim), "%d", BENCH_WIDTH + 1);
+    setenv("COLUMNS", dim, 1);
+    screen = newterm(term != NULL ? term : "xterm", out, in);
+
+    printf("\nrender backends: %dx%d worm game to /dev/null\n", BENCH_WIDTH, BENCH_HEIGHT);
+    printf("%-8s %7s %12s %12s %12s\n", "backend", "frames", "bytes/frame", "writes/frame", "us/frame");
+    for (i=0; renderers[i] != NULL; i++)
+    {
+        if (screen == NULL && renderers[i] == &render_curses)
+        {
+            printf("%-8s (no terminfo for %s)\n", renderers[i]->name, term);
+            continue;
+        }
+        if (screen != NULL)
+        {
+            start_color();
+            init_colors();
+        }
+        bench_backend(renderers[i], &settings, out);
+    }
+
+    if (screen != NULL)
+    {
+        endwin();
+        delscreen(screen);
+    }
+    fclose(out);
+    fclose(in);
+    cleanup_settings(&settings);
+    return EXIT_SUCCESS;
+}
+
+/* Play unpaced games with every player driven by a bot_client() child, timing the round trip. */
+static int bench_bots(void)
+{
+    int g, i;
+    settings_t settings;
+    game_t game;
+    bots_t bots;
+    pid_t kids[MAX_PLS];
+    char name[32];
+    bool over;
+    long long start, ns = 0;
+    unsigned long ticks = 0, late = 0;
+    struct timespec nap = { 0, 1000000L };
+    int ret = EXIT_SUCCESS;
+
+    default_settings(&settings, CLASSIC, MAX_PLS);
+    /* Our own segment, so a game being played meanwhile is left alone. */
+    snprintf(name, sizeof(name), "/drtron-bench-%d", (int) getpid());
+
+    fflush(stdout);
+    for (i=0; i < MAX_PLS; i++)
+    {
+        kids[i] = fork();
+        if (kids[i] == 0)
+        {
+            _exit(bot_client(name, i));
+        }
+    }
+
+    for (g=0; g < BENCH_BOT_GAMES && ret == EXIT_SUCCESS; g++)
+    {
+        settings.seed = g + 1;
+        game_init(&game, &settings, BENCH_WIDTH, BENCH_HEIGHT);
+        if (!bots_open(&bots, name, (1u << MAX_PLS) - 1, DEF_BOT_GRACE, &game))
+        {
+            perror(name);
+            cleanup_game(&game);
+            ret = EXIT_FAILURE;
+            break;
+        }
+        /* Bots only look for a new game every so often; don't count that against them. */
+        for (i=0; i < game.num_players; i++)
+        {
+            while (atomic_load(&bots.shm->reply[i].tick) != 0)
+            {
+                nanosleep(&nap, NULL);
+            }
+        }
+        start = now_ns();
+        do
+        {
+            bots_collect(&bots, &game, NULL);
+            over = game_tick(&game);
+            bots_publish(&bots, &game);
+        } while (!over && game.tick < BENCH_MAX_TICKS);
+        ns += now_ns() - start;
+        ticks += game.tick;
+        for (i=0; i < game.num_players; i++)
+        {
+            late += bots.shm->late[i];
+        }
+        bots_close(&bots);
+        cleanup_game(&game);
+    }
+
+    for (i=0; i < MAX_PLS; i++)
+    {
+        kill(kids[i], SIGTERM);
+        waitpid(kids[i], NULL, 0);
+    }
+
+    printf("\nexternal bots: %d games on %dx%d, %d bot processes, %d us grace\n", BENCH_BOT_GAMES, BENCH_WIDTH, BENCH_HEIGHT, MAX_PLS, DEF_BOT_GRACE);
+    printf("%8s %12s %12s\n", "ticks", "us/tick", "late");
+    printf("%8lu %12.2f %12lu\n", ticks, ns / 1000.0 / ticks, late);
+
+    cleanup_settings(&settings);
+    return ret;
+}
+
+/* Tick an autopiloted DECAY arena on the plain engine and on more and more workers, checking they agree. */
+static int bench_arena(void)
+{
+    int i, t;
+    settings_t settings;
+    game_t game;
+    shards_t shards;
+    const int threads[] = { 0, 1, 2, 4, 8 };
+    long long start, ns, plain_ns = 0;
+    uint64_t plain_hash = 0;
+    int ret = EXIT_SUCCESS;
+
+    default_settings(&settings, DECAY, BENCH_ARENA_PLS);
+
+    printf("\nsharded arena: %d players on %dx%d, decay, %d ticks\n", BENCH_ARENA_PLS, BENCH_ARENA_WIDTH, BENCH_ARENA_HEIGHT, BENCH_ARENA_TICKS);
+    printf("%8s %12s %8s %8s\n", "threads", "us/tick", "speedup", "hash");
+    for (t=0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        settings.seed = 1;
+        game_init(&game, &settings, BENCH_ARENA_WIDTH, BENCH_ARENA_HEIGHT);
+        if (threads[t] > 0)
+        {
+            shards_init(&shards, &game, threads[t], true);
+        }
+        start = now_ns();
+        while (game.tick < BENCH_ARENA_TICKS)
+        {
+            if (threads[t] > 0)
+            {
+                shards_tick(&shards);
+            }
+            else
+            {
+                for (i=0; i < game.num_players; i++)
+                {
+                    game_autopilot(&game, i);
+                }
+                game_tick(&game);
+            }
+        }
+        ns = now_ns() - start;
+        if (threads[t] > 0)
+        {
+            shards_free(&shards);
+        }
+        else
+        {
+            plain_ns = ns;
+            plain_hash = game.hash;
+        }
+
+        printf("%8d %12.1f %7.2fx %8s\n", threads[t], ns / 1000.0 / BENCH_ARENA_TICKS, (double) plain_ns / ns,
+               game.hash == plain_hash ? "same" : "DIFFERS");
+        if (game.hash != plain_hash)
+        {
+            ret = EXIT_FAILURE;
+        }
+        cleanup_game(&game);
+    }
+
+    cleanup_settings(&settings);
+    return ret;
+}
+
+/* Play one autopiloted game of settings on a width x height map, ticking it to the end or, if play_out, */
+/* tracking regions once regions_due() and playing the pockets out once everyone is sealed off. */
+/* RETURN: nanoseconds it took; the tick it was sealed at (0 if never) and the final tick and hash go in the rest. */
+static long long bench_play_out_game(settings_t *settings, int width, int height, bool play_out,
+                                     unsigned long *sealed_at, unsigned long *ticks, uint64_t *hash)
+{
+    int i;
+    game_t game;
+    regions_t regions;
+    bool over, tracking = false;
+    long long start;
+
+    game_init(&game, settings, width, height);
+    start = now_ns();
+    *sealed_at = 0;
+    do
+    {
+        for (i=0; i < game.num_players; i++)
+        {
+            game_autopilot(&game, i);
+        }
+        over = game_tick(&game);
+        /* The same as run_arena(). */
+        if (tracking && !over)
+        {
+            regions_update(&regions, &game);
+        }
+        else if (play_out && !over && regions_due(&game))
+        {
+            tracking = regions_init(&regions, &game);
+        }
+        if (tracking && !over && regions_sealed(&regions, &game))
+        {
+            *sealed_at = game.tick;
+            regions_free(&regions);
+            tracking = false;
+            over = game_play_out(&game, 0);
+        }
+    } while (!over);
+    if (tracking)
+    {
+        regions_free(&regions);
+    }
+    start = now_ns() - start;
+    *ticks = game.tick;
+    *hash = game.hash;
+    cleanup_game(&game);
+    return start;
+}
+
+/* Time autopiloted CLASSIC games ticked to the end against the same games played out pocket by pocket once sealed. */
+static int bench_play_out(void)
+{
+    int c, g, r;
+    /* Players, the biggest map and how many games, each a size smaller, from small games up to an arena. */
+    const struct { int pls, width, height, games; } cases[] = {
+        { 4, BENCH_WIDTH, BENCH_HEIGHT, BENCH_GAMES },
+        { 16, BENCH_WIDTH, BENCH_HEIGHT, BENCH_GAMES },
+        { 64, BENCH_WIDTH, BENCH_HEIGHT, BENCH_GAMES },
+        { BENCH_SEALED_PLS, BENCH_SEALED_WIDTH, BENCH_SEALED_HEIGHT, BENCH_SEALED_GAMES },
+    };
+    settings_t settings;
+    long long tick_ns, out_ns, best_tick_ns, best_out_ns;
+    unsigned long ticks, sealed_at, sum_ticks, sum_sealed, out_ticks;
+    uint64_t hash, out_hash;
+    int ret = EXIT_SUCCESS;
+
+    default_settings(&settings, CLASSIC, 0);
+
+    printf("\nplaying out sealed games: best of %d rounds of classic games, each a size smaller than the last, autopiloted\n", BENCH_ROUNDS);
+    printf("%7s %9s %5s %8s %8s %12s %12s %8s\n", "players", "map", "games", "ticks", "sealed", "ticked us", "played us", "speedup");
+    for (c=0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        settings.num_pls = cases[c].pls;
+        best_tick_ns = best_out_ns = -1;
+        for (r=0; r < BENCH_ROUNDS; r++)
+        {
+            tick_ns = out_ns = 0;
+            sum_ticks = sum_sealed = 0;
+            for (g=0; g < cases[c].games; g++)
+            {
+                tick_ns += bench_play_out_game(&settings, cases[c].width - g, cases[c].height - g / 2, false, &sealed_at, &ticks, &hash);
+                out_ns += bench_play_out_game(&settings, cases[c].width - g, cases[c].height - g / 2, true, &sealed_at, &out_ticks, &out_hash);
+                sum_ticks += ticks;
+                sum_sealed += sealed_at > 0 ? sealed_at : ticks;
+                if (out_ticks != ticks || out_hash != hash)
+                {
+                    fprintf(stderr, "%d players, game %d: played out to tick %lu, hash %016" PRIx64 ", ticked to %lu, hash %016" PRIx64 "\n",
+                            cases[c].pls, g, out_ticks, out_hash, ticks, hash);
+                    ret = EXIT_FAILURE;
+                }
+            }
+            best_tick_ns = (best_tick_ns < 0 || tick_ns < best_tick_ns) ? tick_ns : best_tick_ns;
+            best_out_ns = (best_out_ns < 0 || out_ns < best_out_ns) ? out_ns : best_out_ns;
+        }
+        printf("%7d %4dx%-4d %5d %8lu %8lu %12.1f %12.1f %7.2fx\n", cases[c].pls, cases[c].width, cases[c].height, cases[c].games,
+               sum_ticks, sum_sealed, best_tick_ns / 1000.0, best_out_ns / 1000.0, (double) best_tick_ns / best_out_ns);
+    }
+    printf("(sealed: ticks played before everyone was sealed off, or the whole game if never;\n"
+           " maps under %d tiles are never tracked)\n", TRACK_TILES);
+
+    cleanup_settings(&settings);
+    return ret;
+}
+
+/* Run every benchmark. */
+/* RETURN: EXIT_SUCCESS unless a benchmark found the code misbehaving. */
+int run_bench(void)
+{
+    int ret = EXIT_SUCCESS;
+
+    bench_ticks();
+    if (bench_render() != EXIT_SUCCESS)
+    {
+        ret = EXIT_FAILURE;
+    }
+    if (bench_bots() != EXIT_SUCCESS)
+    {
+        ret = EXIT_FAILURE;
+    }
+    if (bench_arena() != EXIT_SUCCESS)
+    {
+        ret = EXIT_FAILURE;
+    }
+    if (bench_play_out() != EXIT_SUCCESS)
+    {
+        ret = EXIT_FAILURE;
+    }
+    return ret;
+}
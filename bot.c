@@ -0,0 +1,428 @@
+/*
+ * bot.c
+ * Lets programs outside drtron drive players through a POSIX shared memory
+ * segment (DEF_BOT_SHM unless -m says otherwise), laid out as bot_shm_t.
+ *
+ * Protocol:
+ *  - The game creates the segment when a game with bots starts and unlinks it
+ *    when the game ends, holding an flock() on it meanwhile. A segment nobody
+ *    holds is left over from a crash and is replaced; a held one is never
+ *    taken over. A bot opens it, checks magic, version and that its
+ *    player has is_bot set, then maps all size bytes.
+ *  - After every tick the game publishes the state under the seqlock seq: seq
+ *    is odd while it writes tick, hash, over, head, dir, is_out and col, and
+ *    even once they are consistent. It then wakes anyone futex waiting on seq.
+ *    hash is the game's Zobrist hash (see zobrist.c), equal for equal states,
+ *    so a bot can key a transposition table with it.
+ *  - A bot reads a consistent copy (retrying if seq was odd or changed while
+ *    it read), decides, then stores reply[player].dir followed by
+ *    reply[player].tick = tick, bumps replies and futex wakes it.
+ *  - Nothing is serialized: heads are indexes into col, which holds one byte
+ *    per map tile, row by row, non-zero if moving onto it would collide.
+ *
+ * Timeout policy: the game applies replies when the next tick is due (at once
+ * when nothing paces the game). A bot that has not answered for the current
+ * tick by then is waited for at most grace_us more microseconds. After that
+ * the tick goes ahead with the player heading the way it already was, late is
+ * bumped for that player, and the missing reply is ignored if it ever turns up,
+ * since it is for a tick that has gone. A reply that would turn a player
+ * straight back into itself is ignored just as the same key would be.
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drtron.h"
+
+/* Sleep until *addr is no longer val, or rel (if not NULL) has passed. */
+static void futex_wait(atomic_uint *addr, unsigned val, const struct timespec *rel)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, rel, NULL, 0);
+}
+
+/* Wake everyone sleeping on addr. */
+static void futex_wake(atomic_uint *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Microseconds on a clock that only goes forwards. */
+static long long now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* RETURN: true if the segment called name belongs to a game that is still running. */
+bool bots_busy(const char *name)
+{
+    int fd;
+    bool busy;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    /* The game holds a lock on it for as long as it runs; the kernel drops it if the game dies. */
+    busy = flock(fd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+    close(fd);
+    return busy;
+}
+
+/* Create the segment for game and publish its starting state; players with bit i of mask set are bots. */
+/* RETURN: false if the segment could not be made, another running game holds name, or the game has */
+/* more players than it has room for. */
+bool bots_open(bots_t *bots, const char *name, unsigned mask, int grace_us, const game_t *game)
+{
+    int i, fd;
+    size_t size = sizeof(bot_shm_t) + game->map.width * game->map.height;
+    bot_shm_t *shm;
+
+    /* The segment only has room for a game's players, not an arena's. */
+    if (game->num_players > MAX_PLS)
+    {
+        return false;
+    }
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST && !bots_busy(name))
+    {
+        /* Whatever a crashed game left behind is of no use to anyone. */
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0)
+    {
+        return false;
+    }
+    /* Keep fd open and locked until bots_close(), so other games leave the segment alone. */
+    if (flock(fd, LOCK_EX) != 0 || ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+    {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    /* A fresh segment is all zeros, so only fill in what isn't. */
+    shm->size = size;
+    shm->width = game->map.width;
+    shm->height = game->map.height;
+    shm->num_pls = game->num_players;
+    shm->grace_us = grace_us;
+    for (i=0; i < game->num_players; i++)
+    {
+        shm->is_bot[i] = (mask >> i) & 1;
+        /* No reply is for a tick this far off. */
+        atomic_store(&shm->reply[i].tick, UINT64_MAX);
+    }
+    /* Set these last; a bot that sees them can trust the rest. */
+    shm->version = BOT_VERSION;
+    atomic_thread_fence(memory_order_release);
+    shm->magic = BOT_MAGIC;
+
+    bots->shm = shm;
+    bots->fd = fd;
+    bots->name = name;
+    bots_publish(bots, game);
+    return true;
+}
+
+/* Publish the state after a tick and wake the bots. */
+void bots_publish(bots_t *bots, const game_t *game)
+{
+    int i;
+    bot_shm_t *shm = bots->shm;
+    unsigned seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    assert(game->num_players <= MAX_PLS);
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    shm->tick = game->tick;
+    shm->hash = game->hash;
+    shm->over = game->num_out >= game->num_players - 1;
+    for (i=0; i < game->num_players; i++)
+    {
+        shm->head[i] = game->players[i].root->pos;
+        shm->dir[i] = game_heading(game, i);
+        shm->is_out[i] = game->players[i].is_out;
+    }
+    if (game->map.expires == NULL)
+    {
+        /* pl_col is already one byte per tile. */
+        memcpy(shm->col, game->map.pl_col, game->map.width * game->map.height);
+    }
+    else
+    {
+        /* Leave out decayed trail that has not been swept yet. */
+        for (i=0; i < game->map.width * game->map.height; i++)
+        {
+            shm->col[i] = game_blocked(game, i);
+        }
+    }
+
+    atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+    futex_wake(&shm->seq);
+}
+
+/* Apply the bots' replies for this tick, waiting out the grace period for any that are late. */
+void bots_collect(bots_t *bots, game_t *game, FILE *log)
+{
+    int i, way;
+    bot_shm_t *shm = bots->shm;
+    long long deadline = now_us() + shm->grace_us;
+    long long left;
+    unsigned seen;
+    bool waiting;
+    struct timespec rel;
+
+    while (true)
+    {
+        /* Read the counter first so a reply landing after the check still wakes us. */
+        seen = atomic_load_explicit(&shm->replies, memory_order_acquire);
+        waiting = false;
+        for (i=0; i < game->num_players; i++)
+        {
+            if (shm->is_bot[i] && !game->players[i].is_out
+                && atomic_load_explicit(&shm->reply[i].tick, memory_order_acquire) != game->tick)
+            {
+                waiting = true;
+            }
+        }
+        left = deadline - now_us();
+        if (!waiting || left <= 0)
+        {
+            break;
+        }
+        rel.tv_sec = left / 1000000;
+        rel.tv_nsec = (left % 1000000) * 1000;
+        futex_wait(&shm->replies, seen, &rel);
+    }
+
+    for (i=0; i < game->num_players; i++)
+    {
+        if (!shm->is_bot[i] || game->players[i].is_out)
+        {
+            continue;
+        }
+        if (atomic_load_explicit(&shm->reply[i].tick, memory_order_acquire) != game->tick)
+        {
+            shm->late[i]++;
+            continue;
+        }
+        way = atomic_load_explicit(&shm->reply[i].dir, memory_order_relaxed);
+        if (way != game_heading(game, i))
+        {
+            game_turn(game, i, way);
+            if (log != NULL)
+            {
+                replay_turn(log, i, way);
+            }
+        }
+    }
+}
+
+/* Tell the bots the game is over and take the segment away. */
+void bots_close(bots_t *bots)
+{
+    bot_shm_t *shm = bots->shm;
+    unsigned seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    shm->over = true;
+    atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+    futex_wake(&shm->seq);
+
+    shm_unlink(bots->name);
+    munmap(shm, shm->size);
+    close(bots->fd);
+}
+
+/* Map the segment called name, storing its inode in ino. */
+/* RETURN: NULL if there is no game with bots running (yet). */
+static bot_shm_t *bot_attach(const char *name, ino_t *ino)
+{
+    int fd;
+    bot_shm_t *shm;
+    size_t size;
+    struct stat st;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    fstat(fd, &st);
+    *ino = st.st_ino;
+    /* Look at the header first to find out how big the whole thing is. */
+    shm = mmap(NULL, sizeof(bot_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    if (shm->magic != BOT_MAGIC)
+    {
+        /* Still being set up. */
+        munmap(shm, sizeof(bot_shm_t));
+        close(fd);
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    size = shm->size;
+    munmap(shm, sizeof(bot_shm_t));
+
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return shm == MAP_FAILED ? NULL : shm;
+}
+
+/* RETURN: true if the segment mapped as ino has been unlinked (and perhaps replaced). */
+static bool bot_stale(const char *name, ino_t ino)
+{
+    int fd;
+    struct stat st;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return true;
+    }
+    fstat(fd, &st);
+    close(fd);
+    return st.st_ino != ino;
+}
+
+/* Drive player pl (counting from 0) through the segment called name, game after game, until killed. */
+/* It only steers away from whatever is straight ahead; it is here to show how the protocol is used. */
+int bot_client(const char *name, int pl)
+{
+    bot_shm_t *shm;
+    /* Segment mapped now, and the last one we were done with, played or not. */
+    ino_t ino, done = 0;
+    /* Consistent copy of the state. */
+    unsigned seq, last_seq;
+    uint64_t tick;
+    int32_t over, head, way;
+    uint8_t is_out;
+    uint8_t *col;
+    /* Map steps for each way, and where we might go. */
+    int steps[4];
+    int turns[2];
+    struct timespec poll = { 0, 100000000L };
+
+    while (true)
+    {
+        shm = bot_attach(name, &ino);
+        if (shm == NULL)
+        {
+            nanosleep(&poll, NULL);
+            continue;
+        }
+        if (ino == done)
+        {
+            /* The game we finished hasn't taken its segment away yet. */
+            munmap(shm, shm->size);
+            nanosleep(&poll, NULL);
+            continue;
+        }
+        if (shm->version != BOT_VERSION || pl >= shm->num_pls || !shm->is_bot[pl])
+        {
+            fprintf(stderr, "%s: player %d is not a bot in this game; waiting for the next\n", name, pl + 1);
+            munmap(shm, shm->size);
+            done = ino;
+            continue;
+        }
+        col = malloc(shm->width * shm->height);
+        steps[K_UP] = -shm->width;
+        steps[K_DOWN] = shm->width;
+        steps[K_LEFT] = -1;
+        steps[K_RIGHT] = 1;
+        last_seq = 0;
+
+        while (true)
+        {
+            seq = atomic_load_explicit(&shm->seq, memory_order_acquire);
+            if (seq == last_seq || (seq & 1))
+            {
+                /* Nothing new yet; the timeout notices a game that died without saying so. */
+                futex_wait(&shm->seq, seq, &poll);
+                if (atomic_load(&shm->seq) == seq && bot_stale(name, ino))
+                {
+                    break;
+                }
+                continue;
+            }
+            tick = shm->tick;
+            over = shm->over;
+            head = shm->head[pl];
+            way = shm->dir[pl];
+            is_out = shm->is_out[pl];
+            memcpy(col, shm->col, shm->width * shm->height);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&shm->seq, memory_order_relaxed) != seq)
+            {
+                /* Torn read; try again. */
+                continue;
+            }
+            last_seq = seq;
+
+            if (over)
+            {
+                break;
+            }
+            if (is_out)
+            {
+                continue;
+            }
+
+            /* Turn if something is straight ahead. */
+            if (col[head + steps[way]])
+            {
+                /* Don't always favour the same side. */
+                turns[tick & 1] = (way == K_LEFT || way == K_RIGHT) ? K_UP : K_LEFT;
+                turns[!(tick & 1)] = (way == K_LEFT || way == K_RIGHT) ? K_DOWN : K_RIGHT;
+                if (!col[head + steps[turns[0]]])
+                {
+                    way = turns[0];
+                }
+                else if (!col[head + steps[turns[1]]])
+                {
+                    way = turns[1];
+                }
+            }
+
+            atomic_store_explicit(&shm->reply[pl].dir, way, memory_order_relaxed);
+            atomic_store_explicit(&shm->reply[pl].tick, tick, memory_order_release);
+            atomic_fetch_add_explicit(&shm->replies, 1, memory_order_release);
+            futex_wake(&shm->replies);
+        }
+
+        free(col);
+        munmap(shm, shm->size);
+        done = ino;
+    }
+}
@@ -13,12 +13,195 @@
 
 #include "drtron.h"
 
+/* Explain the command line. */
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-r backend] [-d ticks] [-s seed] [-l log] [-V ticks] [-x players] [-m shm] [-D usec]\n"
+            "       %s -j player [-m shm]\n"
+            "       %s -A players [-M mode] [-g WxH] [-t threads] [-T ticks] [-d ticks] [-s seed] [-V ticks]\n"
+            "       %s -c log [-V ticks]\n"
+            "       %s -b\n"
+            "  -r name   draw with the curses (default) or ansi backend\n"
+            "  -d ticks  how long trail lasts in decay mode (default %d)\n"
+            "  -s seed   seed for the first map (default 1)\n"
+            "  -l log    append a replay of every game to log\n"
+            "  -c log    re-run the games in log headless and check every state hash\n"
+            "  -V ticks  check the state hash against a full rehash every so many ticks\n"
+            "  -x list   let external bots drive these players, e.g. 2,3\n"
+            "  -m name   shared memory object bots attach to (default %s)\n"
+            "  -D usec   how long a tick waits for a late bot (default %d)\n"
+            "  -j player be a bot driving player in whatever game is running\n"
+            "  -A n      play a headless arena of n autopiloted players and report on it\n"
+            "  -M mode   classic (default), worm or decay arena\n"
+            "  -g WxH    arena size (default %dx%d)\n"
+            "  -t n      worker threads for the arena (default one per CPU, 0 for the plain engine)\n"
+            "  -T ticks  stop the arena after this many ticks even if it isn't over\n"
+            "  -b        run the benchmarks\n",
+            prog, prog, prog, prog, prog, DEF_DECAY, DEF_BOT_SHM, DEF_BOT_GRACE, ARENA_WIDTH, ARENA_HEIGHT);
+}
+
 int main(int argc, char **argv)
 {
     /* We reuse these settings between games. */
     settings_t settings;
     /* We switch on the return of playgame to decide what action to take. */
     enum playgame_ret game_term = NEW;
+    /* Command line option and replay to check, if any. */
+    int i, opt;
+    const char *check_path = NULL;
+    const char *c;
+    bool bench = false;
+    /* Player to be a bot for, if any. */
+    int bot_pl = 0;
+    /* Arena to play, if any, and how many threads to play it on. */
+    int arena_pls = 0;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long max_ticks = 0;
+    /* Decay asked for, checked before it goes in an int. */
+    long decay;
+    const char *modes[] = { [CLASSIC] = "classic", [WORM] = "worm", [DECAY] = "decay" };
+
+    /* Defaults; the rest are filled in by get_new_settings(). */
+    default_settings(&settings, CLASSIC, 0);
+
+    while ((opt = getopt(argc, argv, "r:d:s:l:c:V:x:m:D:j:A:M:g:t:T:b")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                settings.render = render_find(optarg);
+                if (settings.render == NULL)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd':
+                decay = strtol(optarg, NULL, 0);
+                if (decay < 1 || decay > MAX_DECAY)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                settings.decay = decay;
+                break;
+            case 's':
+                settings.seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                settings.log_path = optarg;
+                break;
+            case 'c':
+                check_path = optarg;
+                break;
+            case 'V':
+                settings.verify = atoi(optarg);
+                break;
+            case 'x':
+                for (c = optarg; *c != '\0'; c++)
+                {
+                    if (*c >= '1' && *c < '1' + MAX_PLS)
+                    {
+                        settings.bots |= 1u << (*c - '1');
+                    }
+                    else if (*c != ',')
+                    {
+                        usage(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                }
+                break;
+            case 'm':
+                settings.bot_shm = optarg;
+                break;
+            case 'D':
+                settings.bot_grace = atoi(optarg);
+                break;
+            case 'j':
+                bot_pl = atoi(optarg);
+                if (bot_pl < 1 || bot_pl > MAX_PLS)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'A':
+                arena_pls = atoi(optarg);
+                if (arena_pls < MIN_PLS)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'M':
+                for (settings.gamemode = 0; settings.gamemode < 3; settings.gamemode++)
+                {
+                    if (strcmp(optarg, modes[settings.gamemode]) == 0)
+                    {
+                        break;
+                    }
+                }
+                if (settings.gamemode == 3)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'g':
+                if (sscanf(optarg, "%dx%d", &settings.width, &settings.height) != 2
+                    || settings.width < 3 || settings.height < 3)
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'T':
+                max_ticks = strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                bench = true;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Neither benchmarks, checking a replay nor being a bot need a screen at all. */
+    if (bench || bot_pl != 0 || arena_pls != 0 || check_path != NULL)
+    {
+        if (bench)
+        {
+            i = run_bench();
+        }
+        else if (bot_pl != 0)
+        {
+            i = bot_client(settings.bot_shm, bot_pl - 1);
+        }
+        else if (arena_pls != 0)
+        {
+            settings.num_pls = arena_pls;
+            i = run_arena(&settings, threads, max_ticks);
+        }
+        else
+        {
+            i = replay_check(check_path, settings.verify);
+        }
+        cleanup_settings(&settings);
+        return i;
+    }
+
+    /* Say so now; once curses is up, a game whose bots have nowhere to go just carries on without them. */
+    if (settings.bots != 0 && bots_busy(settings.bot_shm))
+    {
+        fprintf(stderr, "%s: %s is in use by another game; pick another name with -m\n", argv[0], settings.bot_shm);
+        cleanup_settings(&settings);
+        return EXIT_FAILURE;
+    }
 
     /* Initialize curses because we will use it everywhere. */
     initscr();
@@ -63,7 +246,7 @@ void get_new_settings(settings_t *settings)
     /* Container dimensions. */
     int height, width;
     /* Enums for first two fields. */
-    const char* GM[] = { "Classic", "Worm", NULL };
+    const char* GM[] = { "Classic", "Worm", "Decay", NULL };
     const char* NP[] = { "2", "3", "4", NULL };
     WINDOW *container;  /* So we can have a border. */
     WINDOW *form_win;   /* So we can have the form. */
@@ -184,10 +367,14 @@ void get_new_settings(settings_t *settings)
     {
         settings->gamemode = CLASSIC;
     }
-    else
+    else if (strncmp(field_buffer(fields[0], 0), GM[1], strlen(GM[1])) == 0)
     {
         settings->gamemode = WORM;
     }
+    else
+    {
+        settings->gamemode = DECAY;
+    }
 
     settings->num_pls = atoi(field_buffer(fields[1], 0));
 
@@ -201,6 +388,7 @@ void get_new_settings(settings_t *settings)
            if (buff[j] == ' ') buff[j] = '\0';
        }
        /* Make a new buffer, remembering space for the null terminator. */
+       free(settings->pl_names[i]);
        settings->pl_names[i] = (char *) malloc(strlen(buff) * sizeof(char) + 1);
        /* Copy the forms buffer into our new one. */
        strcpy(settings->pl_names[i], buff);
@@ -223,6 +411,30 @@ void get_new_settings(settings_t *settings)
     refresh();
 }
 
+/* Fill settings in with the defaults for num_pls players of gamemode, every name left empty. */
+/* Free them with cleanup_settings(). */
+void default_settings(settings_t *settings, int gamemode, int num_pls)
+{
+    int i;
+
+    memset(settings, 0, sizeof(*settings));
+    settings->gamemode = gamemode;
+    settings->num_pls = num_pls;
+    /* Empty names become "PlayerN" in game_init(). */
+    for (i=0; i < MAX_PLS; i++)
+    {
+        settings->pl_names[i] = calloc(1, 1);
+    }
+    /* Same map sequence as an unseeded rand(). */
+    settings->seed = 1;
+    settings->render = &render_curses;
+    settings->decay = DEF_DECAY;
+    settings->bot_shm = DEF_BOT_SHM;
+    settings->bot_grace = DEF_BOT_GRACE;
+    settings->width = ARENA_WIDTH;
+    settings->height = ARENA_HEIGHT;
+}
+
 /* Cleanup pl_names in settings. */
 void cleanup_settings(settings_t *settings)
 {
@@ -234,386 +446,221 @@ void cleanup_settings(settings_t *settings)
 }
 
 /* Run through one game based upon settings. */
+/* The simulation ticks on its own thread; this one only reads keys and draws frames. */
 /* RETURN:. */
 enum playgame_ret play_game(settings_t *settings)
 {
-    int i;
-
     /* Ingame menu return status. */
     enum playgame_ret menu_ret;
 
-    /* Map struct. */
-    map_t map;
-
-    /* Array of player structs. */
-    player_t *players;
-    /* Number of players. */
-    int num_players = settings->num_pls;
-    /* Default name (N replaced by player number). */
-    const char* def_name = "PlayerN";
-
-    /* Randomized to assign tiles. */
-    int tile_rand;
+    /* State of the game, owned by the simulation until it is stopped. */
+    game_t game;
+    /* Simulation thread and its channels. */
+    sim_t sim;
+    /* Newest frame published by the simulation. */
+    const frame_t *frame;
+    /* Replay log, if the user asked for one. */
+    FILE *log = NULL;
+    /* Have we offered to fast-forward yet? */
+    bool offered = false;
+    /* External bots, if the user asked for any and the segment could be made. */
+    bots_t bots_seg;
+    bots_t *bots = NULL;
 
     /* Value of key pressed during play. */
     int key;
-    /* Number of players out of play. */
-    int num_out = 0;
-    /* Pointer to next node while traversing player body. */
-    struct player_node *next_node;
-    /* Variable to copy next_node into while processing. */
-    struct player_node *cur_node;
-    /* Position of last node while traversing player body. */
-    int last_pos;
-    /* Temp variable for swapping positions of nodes. */
-    int temp;
+    /* Map dimensions. */
+    int width, height;
 
     /* Setup map. */
     if (settings->fullscreen)
     {
-        map.height = LINES - 1;
-        map.width = COLS - 1;
+        height = LINES - 1;
+        width = COLS - 1;
     }
     else
     {
-        map.height = settings->height;
-        map.width = settings->width;
+        height = settings->height;
+        width = settings->width;
+    }
+
+    if (!game_init(&game, settings, width, height))
+    {
+        return EXIT;
     }
 
+    init_colors();
 
-    /* Now allocate our data-structures based on our settings. */
-    map.base = (char *) malloc(map.width * map.height);
-    map.pl_col = (bool *) malloc(map.width * map.height);
+    /* Wait a little for keys so we are not spinning between frames. */
+    timeout(RENDER_POLL_MS);
+    /* No cursor. */
+    curs_set(0);
 
-    players = (player_t *) malloc(num_players * sizeof(player_t));
-    for (i=0; i < num_players; i++)
+    if (settings->log_path != NULL)
     {
-        players[i].name = settings->pl_names[i];
-        players[i].name_len = strlen(players[i].name);
-        players[i].name_index = 0;
-        /* Default empty names. */
-        if (players[i].name_len == 0)
-        {
-            /* We don't need to hold on to the empty buffer, just free it and make new. */
-            free(players[i].name);
-            /* Add an extra char for null terminator. */
-            players[i].name = (char *) malloc((strlen(def_name) + 1) * sizeof(char));
-            strcpy(players[i].name, def_name);
-            /* Reset name length. */
-            players[i].name_len = strlen(players[i].name);
-            /* Add the players number to the final printed character. */
-            players[i].name[ players[i].name_len - 1 ] = '0' + i + 1;
-        }
-        /* Player starts with only one node. */
-        players[i].nodes_pending = 0;
-        /* Create root node of linked list for each player. */
-        players[i].root = malloc(sizeof(struct player_node));
-        /* Since there are no more struct player_nodes, root has a null pointer. */
-        players[i].root->next = NULL;
-        /* Set the character to be displayed for this root node. */
-        players[i].root->tex = players[i].name[players[i].name_index++];
-        /* All players begin in play. */
-        players[i].is_out = false;
-        /* Initialize player's score. */
-        players[i].score = 0;
+        log = fopen(settings->log_path, "a");
     }
-
-    /* TODO: Allow player to customize their color pair. */
-    /* Players 1-4. */
-    init_pair(1, COLOR_YELLOW, COLOR_BLACK);
-    init_pair(2, COLOR_GREEN, COLOR_BLACK);
-    init_pair(3, COLOR_RED, COLOR_BLACK);
-    init_pair(4, COLOR_BLUE, COLOR_BLACK);
-    /* Other tiles. */
-    init_pair(FLOOR, COLOR_WHITE, COLOR_BLACK);
-    init_pair(WALL, COLOR_WHITE, COLOR_BLACK);
-    init_pair(ADDONE, COLOR_MAGENTA, COLOR_BLACK);
-
-    /* Initialize with a default map. */
-    for (i = 0; i < map.width * map.height; i++)
+    if (settings->bots & ((1u << game.num_players) - 1))
     {
-        /* Surround the map in walls. */
-        if ((i < map.width) || (i > map.width * (map.height-1)) || ((i+1) % map.width == 0) || ((i) % map.width == 0))
+        /* Without the segment the bots' players just go straight, so carry on regardless. */
+        if (bots_open(&bots_seg, settings->bot_shm, settings->bots, settings->bot_grace, &game))
         {
-            map.base[i] = WALL;
-            /* Players collide with walls. */
-            map.pl_col[i] = true;
+            bots = &bots_seg;
         }
-        /* Fill it with floor or more. */
-        else
-        {
-            tile_rand = rand() % 100;
-            if (tile_rand > 5 || settings->gamemode == CLASSIC)
-            {
-                map.base[i] = FLOOR;
-                map.pl_col[i] = false;
-            }
-            else
-            {
-                map.base[i] = ADDONE;
-                map.pl_col[i] = false;
-            }
-        }
-    }
-
-    /* Place the players on the map and give them an initial direction. */
-    switch(num_players)
-    {
-        case 4:
-            /* Lower left. */
-            players[3].root->pos = (map.width * map.height) - (map.width * (map.height/4)) + (map.width/4);
-            players[3].dir = RIGHT;
-        case 3:
-            /* Upper right. */
-            players[2].root->pos = (map.width * (map.height/4)) + (3*map.width/4);
-            players[2].dir = LEFT;
-        case 2:
-            /* Lower right. */
-            players[1].root->pos = (map.width * map.height) - (map.width * (map.height/4)) + (3*map.width/4);
-            players[1].dir = UP;
-            /* Upper left. */
-            players[0].root->pos = (map.width * (map.height/4)) + (map.width/4);
-            players[0].dir = DOWN;
-            break;
-        default:
-            puts("Inproper number of players");
-            cleanup_game(&map, players, num_players);
-            /* Something wrong has occured if an improper number of players reaches this point. */
-            return EXIT;
     }
+    settings->render->begin(STDOUT_FILENO, width, height);
+    sim_start(&sim, &game, log, bots);
 
-    /* Non-blocking getch(). */
-    nodelay(stdscr, TRUE);
-    /* No cursor. */
-    curs_set(0);
-
-    /* Start game loop. */
+    /* Start render loop. */
     while (true)
     {
-        /* Non blocking read of stdin; returns ERR if no key available. */
-        key = getch();
-        /* Process all queued user input since last update. */
-        while (key != ERR)
+        /* Hand all queued user input to the simulation. */
+        while ((key = getch()) != ERR)
         {
             /* Exit on <esc>. */
             if (key == 0x1B)
             {
+                /* Hold the game still while the user decides. */
+                sim_pause(&sim);
+                settings->render->suspend(tribuf_front(&sim.frames));
                 /* Prompt user for input. */
                 menu_ret = ingame_menu();
                 if (menu_ret == RESUME)
                 {
-                    /* User wants to keep playing this game. */
-                    key = getch();
+                    /* User wants to keep playing this game; the menu left the screen blank. */
+                    timeout(RENDER_POLL_MS);
+                    settings->render->draw(tribuf_front(&sim.frames));
+                    sim_resume(&sim);
                     continue;
                 }
                 else
                 {
                     /* User wants to do something else. */
-                    cleanup_game(&map, players, num_players);
-                    return menu_ret;
-                }
-            }
-
-            /* Player one keybinds. */
-            else if (key == 'w' && players[0].dir != DOWN  ) players[0].dir = UP;
-            else if (key == 'a' && players[0].dir != RIGHT ) players[0].dir = LEFT;
-            else if (key == 's' && players[0].dir != UP    ) players[0].dir = DOWN;
-            else if (key == 'd' && players[0].dir != LEFT  ) players[0].dir = RIGHT;
-
-            /* Player two keybinds. */
-            else if (key == KEY_UP    && players[1].dir != DOWN) players[1].dir = UP;
-            else if (key == KEY_LEFT  && players[1].dir != RIGHT) players[1].dir = LEFT;
-            else if (key == KEY_DOWN  && players[1].dir != UP  ) players[1].dir = DOWN;
-            else if (key == KEY_RIGHT && players[1].dir != LEFT) players[1].dir = RIGHT;
-            /* To avoid processing of player 3/4 keybinds when they don't exist. */
-            else if (num_players == 2) { key = getch(); continue; }
-
-            /* Player three keybinds. */
-            else if (key == 'y' && players[2].dir != DOWN) players[2].dir = UP;
-            else if (key == 'g' && players[2].dir != RIGHT) players[2].dir = LEFT;
-            else if (key == 'h' && players[2].dir != UP  ) players[2].dir = DOWN;
-            else if (key == 'j' && players[2].dir != LEFT) players[2].dir = RIGHT;
-            else if (num_players == 3) { key = getch(); continue; }
-
-            /* Player four keybinds. */
-            else if (key == 'p' && players[3].dir != DOWN) players[3].dir = UP;
-            else if (key == 'l' && players[3].dir != RIGHT) players[3].dir = LEFT;
-            else if (key == ';' && players[3].dir != UP  ) players[3].dir = DOWN;
-            else if (key == '\'' && players[3].dir != LEFT ) players[3].dir = RIGHT;
-
-            key = getch();
-        }
-
-        for (i=0; i < num_players; i++)
-        {
-            /* We are only concerned with players in play. */
-            if (!players[i].is_out)
-            {
-                /* If the player can move to the requested tile. */
-                if (map.pl_col[ players[i].root->pos + players[i].dir ] != true)
-                {
-                    /* Start out at root node. */
-                    cur_node = players[i].root;
-                    /* Save position of head so we can move the rest of the nodes along. */
-                    last_pos = cur_node->pos;
-                    /* Actually move root. */
-                    cur_node->pos += players[i].dir;
-                    /* Remember this tile now collides. */
-                    map.pl_col[ cur_node->pos ] = true;
-
-                    /* Check if square should add another player_node. */
-                    if (map.base[ cur_node->pos ] == ADDONE || settings->gamemode == CLASSIC)
+                    sim_stop(&sim);
+                    settings->render->end();
+                    if (bots != NULL)
                     {
-                        /* Replace more tile with floor. */
-                        map.base[ cur_node->pos ] = FLOOR;
-                        /* Make the player longer. */
-                        players[i].nodes_pending++;
+                        bots_close(bots);
                     }
-
-                    /* Now prime the loop with the next node. */
-                    next_node = cur_node->next;
-
-                    while (next_node != NULL)
-                    {
-                        /* For ease of reading. */
-                        cur_node = next_node;
-
-                        /* We need to swap position of current node with last_pos. */
-                        temp = cur_node->pos;
-                        cur_node->pos = last_pos;
-                        last_pos = temp;
-
-                        /* Now move on to the next node (will be null if we are at the end). */
-                        next_node = cur_node->next;
-                    }
-
-                    /* last_pos is now empty so we don't want players colliding with it. */
-                    map.pl_col[ last_pos ] = false;
-
-                    /* Now cur_node contains the last node and last_pos holds its previous position. */
-                    /* If there are nodes_pending to be added, we can add one to the position at temp. */
-                    if (players[i].nodes_pending > 0)
+                    cleanup_game(&game);
+                    if (log != NULL)
                     {
-                        /* We need to allocate a new struct player_node and link it into the list. */
-                        cur_node->next = malloc(sizeof(struct player_node));
-                        /* We are only concerned with this new node. */
-                        next_node = cur_node->next;
-                        cur_node = next_node;
-                        /* Set it's position. */
-                        cur_node->pos = last_pos;
-                        /* Allow players to collide with it. */
-                        map.pl_col[ cur_node->pos ] = true;
-                        /* Remember it is the terminal node. */
-                        cur_node->next = NULL;
-                        /* Set its display character; next index of name or DEF_PL_TEX. */
-                        if (players[i].name_len > players[i].name_index)
-                        {
-                            cur_node->tex = players[i].name[players[i].name_index++];
-                        }
-                        else
-                        {
-                            cur_node->tex = DEF_PL_TEX;
-                        }
-                        /* Remember that we have added another node. */
-                        players[i].nodes_pending--;
-                        /* And give the player a point. */
-                        players[i].score++;
+                        fclose(log);
                     }
-                }
-                /* Player is not out of play, but is unable to move. */
-                else
-                {
-                    /* So we make him out of play. */
-                    players[i].is_out = true;
-                    num_out++;
+                    /* Make getch blocking again. */
+                    nodelay(stdscr, FALSE);
+                    /* Show the cursor again. */
+                    curs_set(1);
+                    return menu_ret;
                 }
             }
+            keyq_push(&sim.input, key);
         }
 
-        /* Check if only one remains. */
-        if (num_out >= (num_players - 1))
+        /* Draw the newest frame, if any; frames we were too slow for are skipped. */
+        frame = tribuf_latest(&sim.frames);
+        if (frame == NULL)
+        {
+            continue;
+        }
+        if (frame->over)
         {
-            if (settings->gamemode == CLASSIC)
+            settings->render->suspend(frame);
+            show_results(frame, settings->gamemode);
+            sim_stop(&sim);
+            settings->render->end();
+            if (bots != NULL)
             {
-                for (i=0; i < num_players; i++)
-                {
-                    if (!players[i].is_out)
-                    {
-                        attron(COLOR_PAIR(i + 1));
-                        mvprintw(2, 2, "%s doesn't suck!", players[i].name);
-                        attroff(COLOR_PAIR(i + 1));
-                        break;
-                    }
-                }
-                i = 1; /* Set i to how many lines we printed. */
+                bots_close(bots);
             }
-            else if (settings->gamemode == WORM)
+            cleanup_game(&game);
+            if (log != NULL)
             {
-                for (i=0; i < num_players; i++)
-                {
-                    attron(COLOR_PAIR(i + 1));
-                    mvprintw(2 + i, 2, "%s scored %d points!", players[i].name, players[i].score);
-                    attroff(COLOR_PAIR(i + 1));
-                }
+                fclose(log);
             }
-            refresh();
-            cleanup_game(&map, players, num_players);
-            nodelay(stdscr, FALSE);
-            mvprintw(2 + i, 2, "Press any key to continue...");
+            curs_set(1);
             getch();
             return REPEAT;
         }
-
-        /* Advance frame. */
-        draw_map(map, players, num_players);
-        usleep(60000);
+        if (frame->sealed && !offered)
+        {
+            /* Nobody can get in anyone's way any more, so the rest could just be skipped. */
+            offered = true;
+            sim_pause(&sim);
+            settings->render->suspend(frame);
+            if (offer_fast_forward())
+            {
+                sim_fast_forward(&sim);
+            }
+            timeout(RENDER_POLL_MS);
+            settings->render->draw(tribuf_front(&sim.frames));
+            sim_resume(&sim);
+            continue;
+        }
+        settings->render->draw(frame);
     }
 }
 
-void draw_map(map_t map, player_t *players, int num_players)
+/* Tell the players how they did. */
+void show_results(const frame_t *frame, int gamemode)
 {
     int i;
-    /*  To traverse player lists. */
-    /* Pointer to next node while traversing player body. */
-    struct player_node *next_node;
-    /* Variable to dereference next_node into while processing. */
-    struct player_node *cur_node;
-
-    /* Move cursor back to top left. */
-    move(0,0);
-    /* Print the base map. */
-    for (i=0; i < map.width * map.height; i++)
+
+    /* Last one standing wins, except in worm where it's all about length. */
+    if (gamemode != WORM)
     {
-        /* Drawing. */
-        addch(map.base[i] | COLOR_PAIR(map.base[i]));
-        if ((i + 1) % map.width == 0)
+        for (i=0; i < frame->num_pls; i++)
         {
-            addch('\n');
+            if (!frame->is_out[i])
+            {
+                attron(COLOR_PAIR(i + 1));
+                mvprintw(2, 2, "%s doesn't suck!", frame->names[i]);
+                attroff(COLOR_PAIR(i + 1));
+                break;
+            }
         }
+        i = 1; /* Set i to how many lines we printed. */
     }
-
-    /* Print players on top of base. */
-    for (i=0; i < num_players; i++)
+    else
     {
-        /* Make colors of each player unique. */
-        /* Ncurses makes us start at index 1 for color pairs.... */
-        attron(COLOR_PAIR(i+1));
-
-        /* Prime loop with root node. */
-        next_node = players[i].root;
-
-        while (next_node != NULL)
+        for (i=0; i < frame->num_pls; i++)
         {
-            cur_node = next_node;
-            /* Draw character at player's position. */
-            mvaddch((cur_node->pos / map.width), (cur_node->pos % map.width), cur_node->tex);
-            /* Move on to the next node; rinse and repeat. */
-            next_node = cur_node->next;
+            attron(COLOR_PAIR(i + 1));
+            mvprintw(2 + i, 2, "%s scored %d points!", frame->names[i], frame->scores[i]);
+            attroff(COLOR_PAIR(i + 1));
         }
-        attroff(COLOR_PAIR(i+1));
     }
-    /* Put it onto the screen. */
+    mvprintw(2 + i, 2, "Press any key to continue...");
     refresh();
+    /* Wait for that key. */
+    nodelay(stdscr, FALSE);
+}
+
+/* Everyone is walled into a pocket of their own; ask whether to skip to the result. */
+/* RETURN: true to fast-forward. */
+bool offer_fast_forward(void)
+{
+    int key;
+    int width = 50, height = 6;  /* Dimensions of container. */
+    WINDOW *container;  /* So we can have a border. */
+
+    container = newwin(height, width, (LINES - height) / 2, (COLS - width) / 2);
+    box(container, 0, 0); /* default border. */
+    mvwprintw(container, 1, 2, "Every player is sealed off from the rest.");
+    mvwprintw(container, 3, 2, "f: fast-forward to the result");
+    mvwprintw(container, 4, 2, "Any other key: play it out");
+    wrefresh(container);
+
+    /* Keys meant for steering should not answer for the user. */
+    flushinp();
+    nodelay(stdscr, FALSE);
+    key = getch();
+    nodelay(stdscr, TRUE);
+
+    delwin(container);
+    erase();
+    refresh();
+    return key == 'f';
 }
 
 /* Display simple ingame menu. */
@@ -692,38 +739,3 @@ enum playgame_ret ingame_menu()
     /* Return user option. */
     return USER_OPT[ret_index];
 }
-
-void cleanup_game(map_t *map, player_t players[], int num_players)
-{
-    int i;
-    /* To traverse player linked lists. */
-    struct player_node *next_node;
-    struct player_node *temp_node;
-
-    /* Free data structures. */
-    free(map->base);
-    free(map->pl_col);
-    /* free(map);. */
-    for (i=0; i < num_players; i++)
-    {
-        /* Prime loop with root. */
-        next_node = players[i].root->next;
-        /* Free up root and then the rest of the nodes. */
-        free(players[i].root);
-        while (next_node != NULL)
-        {
-            /* Save reference to next node. */
-            temp_node = next_node->next;
-            /* Free current node. */
-            free(next_node);
-            /* Restore reference to next node. */
-            next_node = temp_node;
-        }
-    }
-    free(players);
-
-    /* Make getch blocking again. */
-    nodelay(stdscr, FALSE);
-    /* Show the cursor again. */
-    curs_set(1);
-}
@@ -9,6 +9,13 @@
 #      History:
 =============================================================================*/
 
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
 // CONSTANTS //
 //Player count bounds
 #define MIN_PLS 2
@@ -18,17 +25,45 @@
 #define DOWN map.width
 #define LEFT -1
 #define RIGHT 1
+//Default number of ticks DECAY trail lasts
+#define DEF_DECAY 100
+//Longest decay: its decay + 1 buckets are counted in an int
+#define MAX_DECAY (INT_MAX - 1)
+//Expiry of anything that never decays: walls and heads
+#define NEVER_EXPIRES ULONG_MAX
+//External bots: default shared memory name, microseconds a late bot is waited for, layout version
+#define DEF_BOT_SHM "/drtron"
+#define DEF_BOT_GRACE 1000
+#define BOT_MAGIC 0x62747264
+#define BOT_VERSION 2
+//Default arena size: tens of millions of tiles
+#define ARENA_WIDTH 6000
+#define ARENA_HEIGHT 4000
+/*Headless CLASSIC games start tracking regions at tick TRACK_AFTER, when every body in play is that
+* long and a tick walks far more nodes than tracking it looks at tiles, and only on maps of at least
+* TRACK_TILES: smaller games stay in cache whole, so playing them out saves nothing
+*/
+#define TRACK_AFTER 256
+#define TRACK_TILES 65536
 //Map tile markers
 #define FLOOR ' '
 #define WALL '#'
 #define ADDONE '%'
 #define DEF_PL_TEX '+'
+//Simulation timing
+#define TICK_NS 60000000L
+#define RENDER_POLL_MS 5
+//Input queue length (must be a power of two)
+#define KEYQ_LEN 64
+//Number of key codes a keymap covers (all of curses' keys)
+#define KEYMAP_LEN 512
 
 // ENUMS //
 //Gamemodes
 enum gm {
     CLASSIC,
     WORM,
+    DECAY,
 };
 //Return values of play_game()
 enum playgame_ret {
@@ -41,9 +76,11 @@ enum playgame_ret {
 // STRUCTS //
 //Organize data relevant to instantiation of a game
 typedef struct {
-    //CLASSIC or WORM
+    //CLASSIC, WORM or DECAY
     int gamemode;
-    //Number of players in range 2-4
+    //Number of ticks trail lasts in DECAY
+    int decay;
+    //Number of players: 2-4 in a game, from 2 up in a headless arena
     int num_pls;
     //Array of names for the players
     char* pl_names[MAX_PLS];
@@ -51,6 +88,20 @@ typedef struct {
     bool fullscreen;
     //Map dimensions (ignored if fullscreen)
     int width, height;
+    //Seed for the next map; each game picks the seed for the one after it
+    unsigned seed;
+    //File to append a replay of every game to, or NULL
+    const char *log_path;
+    //Check the state hash against a full rehash every this many ticks (0 to never)
+    int verify;
+    //Backend to draw the game with
+    const struct render *render;
+    //Bit i set if player i+1 is driven by an external bot
+    unsigned bots;
+    //Shared memory object bots attach to
+    const char *bot_shm;
+    //Microseconds a tick waits for a bot that has not replied yet
+    int bot_grace;
 } settings_t;
 
 //Hold maps and dimensions thereof
@@ -67,6 +118,11 @@ typedef struct {
     */
     char *base;
     bool *pl_col;
+    /* DECAY only (NULL otherwise): tick at which each colliding tile stops colliding, or NEVER_EXPIRES
+    * Expired trail is only swept out of pl_col at the end of the tick it expires in, so game_blocked()
+    * checks this too
+    */
+    unsigned long *expires;
 } map_t;
 
 //Represents one "node" of a player's "worm"
@@ -102,10 +158,319 @@ typedef struct {
     bool is_out;
 } player_t;
 
+//One drawable tile: the character and the color pair to draw it with
+typedef struct {
+    char tex;
+    unsigned char pair;
+} cell_t;
+
+//Ways a player can be pointed, independent of map width
+enum key_dir {
+    K_UP,
+    K_DOWN,
+    K_LEFT,
+    K_RIGHT,
+};
+
+//What a key does: which player it steers (plus one, 0 if unbound) and which way
+struct key_bind {
+    signed char pl;
+    signed char dir;
+};
+
+//Everything the simulation owns for one game
+typedef struct game {
+    //CLASSIC, WORM or DECAY
+    int gamemode;
+    map_t map;
+    //Base with players drawn on top; kept up to date by game_tick() so a frame is just a copy
+    cell_t *screen;
+    player_t *players;
+    int num_players;
+    //Number of players out of play
+    int num_out;
+    //Number of ticks simulated so far
+    unsigned long tick;
+    //Zobrist hash of the whole state, updated alongside every change to it
+    uint64_t hash;
+    //Check hash against game_rehash() every this many ticks (0 to never)
+    int verify;
+    //Seed the map was generated from
+    unsigned seed;
+    /*DECAY only: trail lasts decay ticks, and is queued to be swept in bucket (expiry % (decay + 1))
+    * of expiring; each bucket holds up to num_players tiles as a player lays one per tick
+    */
+    int decay;
+    int *expiring;
+    int *num_expiring;
+    //Keybinds of the players in this game
+    const struct key_bind *keymap;
+} game_t;
+
+//Immutable snapshot of a game handed from the simulation to the renderer
+typedef struct {
+    unsigned long tick;
+    //Was this the last tick of the game?
+    bool over;
+    //Is every player in play sealed off from the others? (CLASSIC only)
+    bool sealed;
+    int width, height;
+    cell_t *cells;
+    //Only games of up to MAX_PLS players are snapshot
+    int num_pls;
+    const char *names[MAX_PLS];
+    int scores[MAX_PLS];
+    bool is_out[MAX_PLS];
+} frame_t;
+
+//A way of putting frames on the terminal
+typedef struct render {
+    //Name to pick it by on the command line
+    const char *name;
+    //Get ready to draw width x height frames to a file descriptor
+    void (*begin)(int, int, int);
+    //Draw a frame
+    void (*draw)(const frame_t*);
+    //Hand the screen back to curses, showing a frame, before it draws over the game
+    void (*suspend)(const frame_t*);
+    //Done drawing this game
+    void (*end)(void);
+} render_t;
+
+/*Lock-free triple buffer of frames
+* The writer fills slots[back] and swaps it into middle; the reader swaps middle into front
+* whenever the FRESH bit is set, so it always sees the newest frame and stale ones are dropped
+*/
+typedef struct {
+    frame_t slots[3];
+    //Index of the middle slot, possibly or'd with TRIBUF_FRESH
+    atomic_int middle;
+    //Owned by the writer
+    int back;
+    //Owned by the reader
+    int front;
+} tribuf_t;
+#define TRIBUF_FRESH 4
+
+//Single producer, single consumer ring of keys
+typedef struct {
+    int keys[KEYQ_LEN];
+    //Next slot to read; written only by the consumer
+    atomic_uint head;
+    //Next slot to write; written only by the producer
+    atomic_uint tail;
+} keyq_t;
+
+/*Shared memory segment external bots drive players through; see bot.c for the protocol
+* Everything from tick down to col is written by the game under the seqlock seq
+*/
+typedef struct {
+    //BOT_MAGIC and BOT_VERSION, so bots can tell they are looking at the right thing
+    uint32_t magic, version;
+    //Size of the whole segment in bytes
+    uint32_t size;
+    int32_t width, height, num_pls;
+    //Microseconds a tick waits for a bot that has not replied yet
+    int32_t grace_us;
+    //Seqlock: odd while the game is writing; bots futex wait on it for the next tick
+    atomic_uint seq;
+    //Bumped by a bot after it replies; the game futex waits on it
+    atomic_uint replies;
+    //Number of ticks played so far; replies should be for this tick
+    uint64_t tick;
+    //Zobrist hash of the game after that tick, e.g. to key a transposition table
+    uint64_t hash;
+    //Has the game finished?
+    int32_t over;
+    //Head position (index into col), heading (K_UP...) and whether each player is out
+    int32_t head[MAX_PLS];
+    int32_t dir[MAX_PLS];
+    uint8_t is_out[MAX_PLS];
+    //Which players are driven by bots
+    uint8_t is_bot[MAX_PLS];
+    //Replies that missed their tick so far, per player
+    uint32_t late[MAX_PLS];
+    //Written by bots: the way to head (K_UP...), then the tick it is for
+    struct {
+        atomic_int dir;
+        _Atomic uint64_t tick;
+    } reply[MAX_PLS];
+    //One byte per map tile, non-zero if moving onto it would collide
+    uint8_t col[];
+} bot_shm_t;
+
+//Game side of the bot segment
+typedef struct {
+    bot_shm_t *shm;
+    //Segment, held locked while the game runs
+    int fd;
+    //Name to unlink it by
+    const char *name;
+} bots_t;
+
+//Connected regions of free tiles, kept up to date as a CLASSIC game fills them; see region.c
+typedef struct {
+    int width;
+    //Region of every free tile, or -1 where it is filled
+    int *label;
+    //Tiles in each region, and how many labels have been handed out
+    int *sizes;
+    int num_labels, cap_labels;
+    //Filled tiles: a tile of the group each is in, where touching filled tiles (corners too) are grouped
+    int *group;
+    //Splitting: which search (gen * 4 + search) reached each tile, and the tiles each search found
+    unsigned *mark;
+    unsigned gen;
+    int *found[4];
+    int num_found[4], cap_found[4];
+    //Sealed check: the player that can reach each region, valid if claimed_at is the current check
+    int *claimed_by;
+    unsigned *claimed_at;
+    unsigned check;
+} regions_t;
+
+struct shards;
+
+//One horizontal strip of the map and the worker that owns it in a sharded simulation
+typedef struct {
+    struct shards *shards;
+    int idx;
+    //Rows [row_from, row_to) are this strip's, and so are their tiles
+    int row_from, row_to;
+    //Players in play with their heads in the strip, and the list for next tick
+    int *pls, *next_pls;
+    int num_pls;
+    //Players wanting to move onto this strip's tiles, sent by the strip above, this strip and the strip below
+    int *claims[3];
+    int num_claims[3];
+    //Claims won this tick
+    int num_won;
+    //Private copy of the game header to make moves on; see shard.c
+    game_t local;
+    //Private expiry bucket counts, for DECAY
+    int *num_expiring;
+    pthread_t thread;
+} strip_t;
+
+//A game ticked by a pool of workers, one per strip
+typedef struct shards {
+    game_t *game;
+    int num_strips;
+    strip_t *strips;
+    //Steer every player with game_autopilot() before it moves
+    bool autopilot;
+    //Lowest player claiming each tile this tick, or -1
+    int *claim;
+    //Phases of a tick are separated by this
+    pthread_barrier_t barrier;
+    //Set before releasing the workers to make them exit
+    bool quit;
+} shards_t;
+
+//Simulation thread and the channels to and from it
+typedef struct {
+    game_t *game;
+    pthread_t thread;
+    //Frames flow out...
+    tribuf_t frames;
+    //...and keys flow in
+    keyq_t input;
+    //Replay log written as we go, or NULL
+    FILE *log;
+    //External bots, or NULL
+    bots_t *bots;
+    //Requests from the render thread; fast hands every player to the autopilot and stops pacing ticks
+    atomic_bool pause, quit, fast;
+    //Only used to park the thread while paused
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} sim_t;
+
 // PROTOTYPES //
 void get_new_settings(settings_t*);
+void default_settings(settings_t*, int, int);
 void cleanup_settings(settings_t*);
 enum playgame_ret play_game(settings_t*);
-void draw_map(map_t, player_t*, int);
 enum playgame_ret ingame_menu(void);
-void cleanup_game(map_t*, player_t[], int);
+void show_results(const frame_t*, int);
+bool offer_fast_forward(void);
+
+//game.c
+bool game_init(game_t*, settings_t*, int, int);
+void game_steer(game_t*, int);
+void game_turn(game_t*, int, int);
+int game_heading(const game_t*, int);
+void game_autopilot(game_t*, int);
+bool game_blocked(const game_t*, int);
+bool game_tick(game_t*);
+void game_move(game_t*, int);
+bool game_play_out(game_t*, unsigned long);
+void game_knock_out(game_t*, int);
+void game_sweep(game_t*, int, int);
+bool game_finish_tick(game_t*);
+void game_snapshot(const game_t*, frame_t*);
+void cleanup_game(game_t*);
+
+//zobrist.c
+uint64_t zobrist_cell(int);
+uint64_t zobrist_addone(int);
+uint64_t zobrist_head(int, int);
+uint64_t zobrist_dir(int, int);
+uint64_t zobrist_pending(int, int);
+uint64_t zobrist_out(int);
+uint64_t zobrist_expiry(int, unsigned long);
+uint64_t game_rehash(const game_t*);
+
+//replay.c
+void replay_header(FILE*, const game_t*);
+void replay_key(FILE*, int);
+void replay_turn(FILE*, int, int);
+void replay_tick(FILE*, const game_t*);
+int replay_check(const char*, int);
+
+//render.c
+extern const render_t render_curses, render_ansi;
+//Every backend, NULL terminated
+extern const render_t *const renderers[];
+void init_colors(void);
+const render_t *render_find(const char*);
+void draw_map(const frame_t*);
+
+//bot.c
+bool bots_busy(const char*);
+bool bots_open(bots_t*, const char*, unsigned, int, const game_t*);
+void bots_publish(bots_t*, const game_t*);
+void bots_collect(bots_t*, game_t*, FILE*);
+void bots_close(bots_t*);
+int bot_client(const char*, int);
+
+//region.c
+bool regions_due(const game_t*);
+bool regions_init(regions_t*, const game_t*);
+void regions_update(regions_t*, const game_t*);
+bool regions_sealed(regions_t*, const game_t*);
+void regions_free(regions_t*);
+
+//shard.c
+bool shards_init(shards_t*, game_t*, int, bool);
+bool shards_tick(shards_t*);
+void shards_free(shards_t*);
+int run_arena(settings_t*, int, unsigned long);
+
+//bench.c
+int run_bench(void);
+
+//sim.c
+void tribuf_init(tribuf_t*, int, int);
+frame_t *tribuf_back(tribuf_t*);
+void tribuf_publish(tribuf_t*);
+const frame_t *tribuf_latest(tribuf_t*);
+const frame_t *tribuf_front(tribuf_t*);
+void tribuf_free(tribuf_t*);
+bool keyq_push(keyq_t*, int);
+bool keyq_pop(keyq_t*, int*);
+void sim_start(sim_t*, game_t*, FILE*, bots_t*);
+void sim_pause(sim_t*);
+void sim_resume(sim_t*);
+void sim_stop(sim_t*);
+void sim_fast_forward(sim_t*);
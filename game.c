@@ -0,0 +1,812 @@
+/*
+ * game.c
+ * Rules of drtron: setting up a game, steering and advancing it a tick at a time.
+ * Nothing in here touches the screen so it can run on its own thread.
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <assert.h>
+#include <curses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drtron.h"
+
+_Static_assert(KEY_MAX < KEYMAP_LEN, "keymaps too small for curses keys");
+
+/* Draw the base tile at pos onto the screen. */
+static void show_base(game_t *game, int pos)
+{
+    game->screen[pos].tex = game->map.base[pos];
+    game->screen[pos].pair = game->map.base[pos];
+}
+
+/* Draw a player node onto the screen; ncurses makes us start at color pair 1. */
+static void show_node(game_t *game, struct player_node *node, int pl)
+{
+    game->screen[node->pos].tex = node->tex;
+    game->screen[node->pos].pair = pl + 1;
+}
+
+/* Mark pos as colliding or not, keeping the hash in step. */
+static void set_col(game_t *game, int pos, bool col)
+{
+    if (game->map.pl_col[pos] != col)
+    {
+        game->map.pl_col[pos] = col;
+        game->hash ^= zobrist_cell(pos);
+    }
+}
+
+/* Point player pl in dir, keeping the hash in step. */
+static void turn(game_t *game, int pl, int dir)
+{
+    game->hash ^= zobrist_dir(pl, game->players[pl].dir) ^ zobrist_dir(pl, dir);
+    game->players[pl].dir = dir;
+}
+
+/* Queue (or with a negative count, use up) nodes for player pl, keeping the hash in step. */
+static void add_pending(game_t *game, int pl, int count)
+{
+    player_t *player = &game->players[pl];
+
+    game->hash ^= zobrist_pending(pl, player->nodes_pending) ^ zobrist_pending(pl, player->nodes_pending + count);
+    player->nodes_pending += count;
+}
+
+/* Surround the map in walls and fill it with floor or more; gamemode is a constant in each fill kernel. */
+static inline __attribute__((always_inline)) void fill_body(game_t *game, const int gamemode)
+{
+    int x, y;
+    map_t map = game->map;
+    /* Start of the row being filled. */
+    char *base;
+    bool *pl_col;
+
+    /* Top and bottom rows are all wall; players collide with walls. */
+    memset(map.base, WALL, map.width);
+    memset(map.pl_col, true, map.width);
+    memset(map.base + map.width * (map.height - 1), WALL, map.width);
+    memset(map.pl_col + map.width * (map.height - 1), true, map.width);
+
+    for (y=1; y < map.height - 1; y++)
+    {
+        base = map.base + y * map.width;
+        pl_col = map.pl_col + y * map.width;
+
+        base[0] = base[map.width - 1] = WALL;
+        pl_col[0] = pl_col[map.width - 1] = true;
+        memset(pl_col + 1, false, map.width - 2);
+
+        if (gamemode != WORM)
+        {
+            memset(base + 1, FLOOR, map.width - 2);
+        }
+        else
+        {
+            for (x=1; x < map.width - 1; x++)
+            {
+                base[x] = (rand() % 100 > 5) ? FLOOR : ADDONE;
+            }
+        }
+    }
+}
+
+static void fill_classic(game_t *game) { fill_body(game, CLASSIC); }
+static void fill_worm(game_t *game) { fill_body(game, WORM); }
+static void fill_decay(game_t *game) { fill_body(game, DECAY); }
+
+/* Map fill for each gamemode. */
+static void (*const fill_kernels[])(game_t*) = {
+    [CLASSIC] = fill_classic,
+    [WORM] = fill_worm,
+    [DECAY] = fill_decay,
+};
+
+/* Keybinds of each player; pl is one more than the player index so unbound keys are 0. */
+#define KEYS_PL1 \
+    ['w'] = { 1, K_UP }, ['a'] = { 1, K_LEFT }, ['s'] = { 1, K_DOWN }, ['d'] = { 1, K_RIGHT }
+#define KEYS_PL2 \
+    [KEY_UP] = { 2, K_UP }, [KEY_LEFT] = { 2, K_LEFT }, [KEY_DOWN] = { 2, K_DOWN }, [KEY_RIGHT] = { 2, K_RIGHT }
+#define KEYS_PL3 \
+    ['y'] = { 3, K_UP }, ['g'] = { 3, K_LEFT }, ['h'] = { 3, K_DOWN }, ['j'] = { 3, K_RIGHT }
+#define KEYS_PL4 \
+    ['p'] = { 4, K_UP }, ['l'] = { 4, K_LEFT }, [';'] = { 4, K_DOWN }, ['\''] = { 4, K_RIGHT }
+
+/* Keymap for each player count, so keys of players who don't exist are simply unbound. */
+static const struct key_bind keymap_2[KEYMAP_LEN] = { KEYS_PL1, KEYS_PL2 };
+static const struct key_bind keymap_3[KEYMAP_LEN] = { KEYS_PL1, KEYS_PL2, KEYS_PL3 };
+static const struct key_bind keymap_4[KEYMAP_LEN] = { KEYS_PL1, KEYS_PL2, KEYS_PL3, KEYS_PL4 };
+static const struct key_bind *const keymaps[MAX_PLS + 1] = {
+    [2] = keymap_2,
+    [3] = keymap_3,
+    [4] = keymap_4,
+};
+
+/* Spread more players than there are keyboard layouts for over a grid, for headless arenas. */
+/* RETURN: false if the map is too small to give each a tile of room on every side. */
+static bool place_arena(game_t *game)
+{
+    int k;
+    /* The direction macros need a map in scope. */
+    map_t map = game->map;
+    int n = game->num_players;
+    /* Inside of the walls, and the grid of cells it is cut into. */
+    int inner_w = map.width - 2, inner_h = map.height - 2;
+    int cols = 1, rows, cell_w, cell_h;
+    const int dirs[] = { UP, RIGHT, DOWN, LEFT };
+
+    /* Roughly square cells. */
+    while ((long long) cols * cols * inner_h < (long long) n * inner_w)
+    {
+        cols++;
+    }
+    rows = (n + cols - 1) / cols;
+    cell_w = inner_w / cols;
+    cell_h = inner_h / rows;
+    if (cell_w < 3 || cell_h < 3)
+    {
+        return false;
+    }
+
+    for (k=0; k < n; k++)
+    {
+        game->players[k].root->pos = (1 + (k / cols) * cell_h + cell_h / 2) * map.width
+                                   + 1 + (k % cols) * cell_w + cell_w / 2;
+        game->players[k].dir = dirs[k % 4];
+    }
+    return true;
+}
+
+/* Build a new game of width x height from settings. */
+/* RETURN: false if the settings could not be used. */
+bool game_init(game_t *game, settings_t *settings, int width, int height)
+{
+    int i;
+    /* Entries in the decay bucket ring. */
+    size_t ring;
+    /* Players array for short. */
+    player_t *players;
+    /* Number of players. */
+    int num_players = settings->num_pls;
+    /* Default name (N replaced by player number). */
+    const char* def_name = "PlayerN";
+    /* Name of every arena player past those settings has names for. */
+    static char arena_name[] = "Bot";
+    /* The direction macros need a map in scope. */
+    map_t map;
+
+    game->gamemode = settings->gamemode;
+    game->num_players = num_players;
+    game->num_out = 0;
+    game->tick = 0;
+    game->verify = settings->verify;
+    /* Every map comes from a known seed so a replay can rebuild it. */
+    game->seed = settings->seed;
+    srand(game->seed);
+
+    map.width = width;
+    map.height = height;
+
+    /* Now allocate our data-structures based on our settings. */
+    map.base = (char *) malloc((size_t) map.width * map.height);
+    map.pl_col = (bool *) malloc((size_t) map.width * map.height);
+    game->screen = (cell_t *) malloc((size_t) map.width * map.height * sizeof(cell_t));
+
+    /* Decaying trail is stamped with its expiry rather than kept in player bodies. */
+    game->decay = settings->decay;
+    map.expires = NULL;
+    game->expiring = NULL;
+    game->num_expiring = NULL;
+    if (game->gamemode == DECAY)
+    {
+        if (game->decay < 1)
+        {
+            game->decay = DEF_DECAY;
+        }
+        map.expires = (unsigned long *) malloc((size_t) map.width * map.height * sizeof(unsigned long));
+        /* Every player can queue a tile in each of the decay + 1 buckets, which adds up fast in an arena. */
+        ring = ((size_t) game->decay + 1) * num_players;
+        if (game->decay <= MAX_DECAY && ring <= SIZE_MAX / sizeof(int))
+        {
+            game->expiring = (int *) malloc(ring * sizeof(int));
+            game->num_expiring = (int *) calloc(game->decay + 1, sizeof(int));
+        }
+    }
+    if (map.base == NULL || map.pl_col == NULL || game->screen == NULL
+        || (game->gamemode == DECAY && (map.expires == NULL || game->expiring == NULL || game->num_expiring == NULL)))
+    {
+        if (game->gamemode == DECAY)
+        {
+            fprintf(stderr, "not enough memory for %d players on a %dx%d map with %d ticks of decay\n",
+                    num_players, width, height, game->decay);
+        }
+        else
+        {
+            fprintf(stderr, "not enough memory for a %dx%d map\n", width, height);
+        }
+        free(map.base);
+        free(map.pl_col);
+        free(map.expires);
+        free(game->screen);
+        free(game->expiring);
+        free(game->num_expiring);
+        return false;
+    }
+    if (game->gamemode == DECAY)
+    {
+        for (i = 0; i < map.width * map.height; i++)
+        {
+            map.expires[i] = NEVER_EXPIRES;
+        }
+    }
+
+    players = (player_t *) malloc(num_players * sizeof(player_t));
+    for (i=0; i < num_players; i++)
+    {
+        players[i].name = i < MAX_PLS ? settings->pl_names[i] : arena_name;
+        players[i].name_len = strlen(players[i].name);
+        players[i].name_index = 0;
+        /* Default empty names. */
+        if (players[i].name_len == 0)
+        {
+            /* We don't need to hold on to the empty buffer, just free it and make new. */
+            free(players[i].name);
+            /* Add an extra char for null terminator. */
+            players[i].name = (char *) malloc((strlen(def_name) + 1) * sizeof(char));
+            strcpy(players[i].name, def_name);
+            /* Reset name length. */
+            players[i].name_len = strlen(players[i].name);
+            /* Add the players number to the final printed character. */
+            players[i].name[ players[i].name_len - 1 ] = '0' + i + 1;
+            /* Settings still owns the name, so hand it the new buffer. */
+            settings->pl_names[i] = players[i].name;
+        }
+        /* Player starts with only one node. */
+        players[i].nodes_pending = 0;
+        /* Create root node of linked list for each player. */
+        players[i].root = malloc(sizeof(struct player_node));
+        /* Since there are no more struct player_nodes, root has a null pointer. */
+        players[i].root->next = NULL;
+        /* Set the character to be displayed for this root node. */
+        players[i].root->tex = players[i].name[players[i].name_index++];
+        /* All players begin in play. */
+        players[i].is_out = false;
+        /* Initialize player's score. */
+        players[i].score = 0;
+    }
+
+    game->map = map;
+    game->players = players;
+
+    /* Initialize with a default map. */
+    fill_kernels[game->gamemode](game);
+    for (i = 0; i < map.width * map.height; i++)
+    {
+        show_base(game, i);
+    }
+    /* Chain on to the seed for the next game so repeats get new maps. */
+    settings->seed = rand();
+
+    /* Place the players on the map and give them an initial direction. */
+    switch(num_players)
+    {
+        case 4:
+            /* Lower left. */
+            players[3].root->pos = (map.width * map.height) - (map.width * (map.height/4)) + (map.width/4);
+            players[3].dir = RIGHT;
+        case 3:
+            /* Upper right. */
+            players[2].root->pos = (map.width * (map.height/4)) + (3*map.width/4);
+            players[2].dir = LEFT;
+        case 2:
+            /* Lower right. */
+            players[1].root->pos = (map.width * map.height) - (map.width * (map.height/4)) + (3*map.width/4);
+            players[1].dir = UP;
+            /* Upper left. */
+            players[0].root->pos = (map.width * (map.height/4)) + (map.width/4);
+            players[0].dir = DOWN;
+            break;
+        default:
+            if (num_players > MAX_PLS && place_arena(game))
+            {
+                break;
+            }
+            puts("Inproper number of players");
+            cleanup_game(game);
+            /* Something wrong has occured if an improper number of players reaches this point. */
+            return false;
+    }
+    /* The corner layout doesn't look at the map size, so a small map can put heads on or past the walls. */
+    for (i=0; i < num_players; i++)
+    {
+        if (players[i].root->pos / map.width < 1 || players[i].root->pos / map.width > map.height - 2
+            || players[i].root->pos % map.width < 1 || players[i].root->pos % map.width > map.width - 2)
+        {
+            printf("a %dx%d map is too small for %d players\n", map.width, map.height, num_players);
+            cleanup_game(game);
+            return false;
+        }
+    }
+
+    for (i=0; i < num_players; i++)
+    {
+        show_node(game, players[i].root, i);
+    }
+
+    /* From here on the hash is only ever updated incrementally. */
+    game->hash = game_rehash(game);
+
+    /* Nobody can share a keyboard with an arena. */
+    game->keymap = num_players <= MAX_PLS ? keymaps[num_players] : NULL;
+
+    return true;
+}
+
+/* Point player pl in direction way (K_UP...), unless that would turn it straight back into itself. */
+void game_turn(game_t *game, int pl, int way)
+{
+    /* The direction macros need a map in scope. */
+    map_t map = game->map;
+    const int dirs[] = { [K_UP] = UP, [K_DOWN] = DOWN, [K_LEFT] = LEFT, [K_RIGHT] = RIGHT };
+
+    if (way < K_UP || way > K_RIGHT || game->players[pl].dir == -dirs[way])
+    {
+        return;
+    }
+    turn(game, pl, dirs[way]);
+}
+
+/* Which way (K_UP...) player pl is heading. */
+int game_heading(const game_t *game, int pl)
+{
+    int dir = game->players[pl].dir;
+
+    if (dir == LEFT)
+    {
+        return K_LEFT;
+    }
+    else if (dir == RIGHT)
+    {
+        return K_RIGHT;
+    }
+    return dir < 0 ? K_UP : K_DOWN;
+}
+
+/* Change a player's direction based on a key pressed. */
+void game_steer(game_t *game, int key)
+{
+    /* Who the key belongs to and where it points. */
+    struct key_bind bind;
+
+    if (key < 0 || key >= KEYMAP_LEN)
+    {
+        return;
+    }
+    bind = game->keymap[key];
+    if (bind.pl != 0)
+    {
+        game_turn(game, bind.pl - 1, bind.dir);
+    }
+}
+
+/* Steer player pl away from whatever is straight ahead, for games nobody is at the keyboard for. */
+void game_autopilot(game_t *game, int pl)
+{
+    player_t *player = &game->players[pl];
+    map_t map = game->map;
+    /* The two ways we could turn, tried in an order that varies so players don't all spiral alike. */
+    int turns[2];
+    int first = (game->tick + pl) & 1;
+
+    if (player->is_out || !game_blocked(game, player->root->pos + player->dir))
+    {
+        return;
+    }
+    if (player->dir == LEFT || player->dir == RIGHT)
+    {
+        turns[first] = UP;
+        turns[!first] = DOWN;
+    }
+    else
+    {
+        turns[first] = LEFT;
+        turns[!first] = RIGHT;
+    }
+    if (!game_blocked(game, player->root->pos + turns[0]))
+    {
+        turn(game, pl, turns[0]);
+    }
+    else if (!game_blocked(game, player->root->pos + turns[1]))
+    {
+        turn(game, pl, turns[1]);
+    }
+}
+
+/* Would a player moving onto pos collide? */
+/* Trail that has expired counts as gone even before decay_sweep() gets to it. */
+bool game_blocked(const game_t *game, int pos)
+{
+    return game->map.pl_col[pos] && (game->map.expires == NULL || game->map.expires[pos] > game->tick);
+}
+
+/* Move player pl's head along in DECAY, leaving trail behind it; the move must not be blocked. */
+static void decay_move(game_t *game, int pl)
+{
+    player_t *player = &game->players[pl];
+    map_t map = game->map;
+    int last_pos = player->root->pos;
+    int pos = last_pos + player->dir;
+    unsigned long expiry = game->tick + game->decay;
+    int bucket = expiry % (game->decay + 1);
+
+    /* Moving onto trail that has expired but not been swept yet. */
+    if (map.pl_col[pos])
+    {
+        game->hash ^= zobrist_expiry(pos, map.expires[pos]);
+    }
+    player->root->pos = pos;
+    game->hash ^= zobrist_head(pl, last_pos) ^ zobrist_head(pl, pos);
+    set_col(game, pos, true);
+    map.expires[pos] = NEVER_EXPIRES;
+    show_node(game, player->root, pl);
+
+    /* Leave trail where the head was and queue it to be swept when it expires. */
+    set_col(game, last_pos, true);
+    map.expires[last_pos] = expiry;
+    game->hash ^= zobrist_expiry(last_pos, expiry);
+    game->screen[last_pos].tex = DEF_PL_TEX;
+    game->screen[last_pos].pair = pl + 1;
+    game->expiring[bucket * game->num_players + game->num_expiring[bucket]++] = last_pos;
+
+    /* Points for staying alive, as in classic. */
+    player->score++;
+}
+
+/* Clear entries [first, last) of the trail expiring this tick off the map and screen, touching nothing else. */
+/* No tile is in a bucket twice, so separate ranges can be swept at once. */
+void game_sweep(game_t *game, int first, int last)
+{
+    int k, pos;
+    int *expiring = game->expiring + (game->tick % (game->decay + 1)) * game->num_players;
+
+    for (k=first; k < last; k++)
+    {
+        pos = expiring[k];
+        /* Unless a head has since moved onto it. */
+        if (game->map.expires[pos] == game->tick)
+        {
+            game->hash ^= zobrist_expiry(pos, game->tick);
+            set_col(game, pos, false);
+            show_base(game, pos);
+        }
+    }
+}
+
+/* Clear all trail expiring this tick and empty its bucket. */
+static void decay_sweep(game_t *game)
+{
+    int bucket = game->tick % (game->decay + 1);
+
+    game_sweep(game, 0, game->num_expiring[bucket]);
+    game->num_expiring[bucket] = 0;
+}
+
+/* Move player pl one tile along; the move must not be blocked. */
+/* gamemode is a constant wherever this is inlined. */
+static inline __attribute__((always_inline)) void move_body(game_t *game, int pl, const int gamemode)
+{
+    map_t map = game->map;
+    player_t *player = &game->players[pl];
+    /* Pointer to next node while traversing player body. */
+    struct player_node *next_node;
+    /* Variable to copy next_node into while processing. */
+    struct player_node *cur_node;
+    /* Position of last node while traversing player body. */
+    int last_pos;
+    /* Temp variable for swapping positions of nodes. */
+    int temp;
+
+    /* Decaying trail is laid on the map, so there is no body to move. */
+    if (gamemode == DECAY)
+    {
+        decay_move(game, pl);
+        return;
+    }
+
+    /* Start out at root node. */
+    cur_node = player->root;
+    /* Save position of head so we can move the rest of the nodes along. */
+    last_pos = cur_node->pos;
+    /* Actually move root. */
+    cur_node->pos += player->dir;
+    game->hash ^= zobrist_head(pl, last_pos) ^ zobrist_head(pl, cur_node->pos);
+    /* Remember this tile now collides. */
+    set_col(game, cur_node->pos, true);
+    show_node(game, cur_node, pl);
+
+    /* Check if square should add another player_node; in classic every square does. */
+    if (gamemode == CLASSIC)
+    {
+        add_pending(game, pl, 1);
+    }
+    else if (map.base[ cur_node->pos ] == ADDONE)
+    {
+        game->hash ^= zobrist_addone(cur_node->pos);
+        /* Replace more tile with floor. */
+        map.base[ cur_node->pos ] = FLOOR;
+        /* Make the player longer. */
+        add_pending(game, pl, 1);
+    }
+
+    /* Now prime the loop with the next node. */
+    next_node = cur_node->next;
+
+    while (next_node != NULL)
+    {
+        /* For ease of reading. */
+        cur_node = next_node;
+
+        /* We need to swap position of current node with last_pos. */
+        temp = cur_node->pos;
+        cur_node->pos = last_pos;
+        last_pos = temp;
+        show_node(game, cur_node, pl);
+
+        /* Now move on to the next node (will be null if we are at the end). */
+        next_node = cur_node->next;
+    }
+
+    /* last_pos is now empty so we don't want players colliding with it. */
+    set_col(game, last_pos, false);
+    show_base(game, last_pos);
+
+    /* Now cur_node contains the last node and last_pos holds its previous position. */
+    /* If there are nodes_pending to be added, we can add one to the position at temp. */
+    if (player->nodes_pending > 0)
+    {
+        /* We need to allocate a new struct player_node and link it into the list. */
+        cur_node->next = malloc(sizeof(struct player_node));
+        /* We are only concerned with this new node. */
+        next_node = cur_node->next;
+        cur_node = next_node;
+        /* Set it's position. */
+        cur_node->pos = last_pos;
+        /* Allow players to collide with it. */
+        set_col(game, cur_node->pos, true);
+        /* Remember it is the terminal node. */
+        cur_node->next = NULL;
+        /* Set its display character; next index of name or DEF_PL_TEX. */
+        if (player->name_len > player->name_index)
+        {
+            cur_node->tex = player->name[player->name_index++];
+        }
+        else
+        {
+            cur_node->tex = DEF_PL_TEX;
+        }
+        show_node(game, cur_node, pl);
+        /* Remember that we have added another node. */
+        add_pending(game, pl, -1);
+        /* And give the player a point. */
+        player->score++;
+    }
+}
+
+/* Take player pl, who is unable to move, out of play. */
+void game_knock_out(game_t *game, int pl)
+{
+    game->players[pl].is_out = true;
+    game->hash ^= zobrist_out(pl);
+    game->num_out++;
+}
+
+/* Count a tick as done, checking the hash if asked to. */
+/* RETURN: true once only one player (or none) remains. */
+bool game_finish_tick(game_t *game)
+{
+    game->tick++;
+
+    /* Catch an incremental update that missed a change. */
+    if (game->verify > 0 && game->tick % game->verify == 0)
+    {
+        assert(game->hash == game_rehash(game));
+    }
+
+    /* Check if only one remains. */
+    return game->num_out >= (game->num_players - 1);
+}
+
+/* Move every player in play one tile along. */
+/* gamemode is a constant wherever this is inlined, so the tests for other modes fold away. */
+/* RETURN: true once only one player (or none) remains. */
+static inline __attribute__((always_inline)) bool tick_body(game_t *game, const int gamemode)
+{
+    int i;
+    map_t map = game->map;
+    player_t *players = game->players;
+
+    for (i=0; i < game->num_players; i++)
+    {
+        /* We are only concerned with players in play. */
+        if (!players[i].is_out)
+        {
+            /* If the player can move to the requested tile. */
+            if (gamemode == DECAY ? !game_blocked(game, players[i].root->pos + players[i].dir)
+                                  : map.pl_col[ players[i].root->pos + players[i].dir ] != true)
+            {
+                move_body(game, i, gamemode);
+            }
+            /* Player is not out of play, but is unable to move. */
+            else
+            {
+                /* So we make him out of play. */
+                game_knock_out(game, i);
+            }
+        }
+    }
+
+    if (gamemode == DECAY)
+    {
+        decay_sweep(game);
+    }
+
+    return game_finish_tick(game);
+}
+
+/* Move player pl one tile along, for engines that decide for themselves who may move; the move must not be blocked. */
+void game_move(game_t *game, int pl)
+{
+    switch (game->gamemode)
+    {
+        case CLASSIC:
+            move_body(game, pl, CLASSIC);
+            break;
+        case WORM:
+            move_body(game, pl, WORM);
+            break;
+        case DECAY:
+            move_body(game, pl, DECAY);
+            break;
+    }
+}
+
+/* Autopilot player pl through the move it would make on tick. */
+/* RETURN: false if it was knocked out instead. */
+static bool play_step(game_t *game, int pl, unsigned long tick)
+{
+    /* Which way the autopilot turns depends on the tick. */
+    game->tick = tick;
+    game_autopilot(game, pl);
+    if (game_blocked(game, game->players[pl].root->pos + game->players[pl].dir))
+    {
+        game_knock_out(game, pl);
+        return false;
+    }
+    game_move(game, pl);
+    return true;
+}
+
+/* Autopilot a game where no player can reach another's free tiles to its end, or to tick limit if that is not 0. */
+/* Players are played one at a time, each only as far as the game can still last: whoever is ahead waits */
+/* for the next player to catch up, then the two go step for step until one is out. Pockets never meet */
+/* and the hash does not care what order tiles fill in, so the game ends up just as ticking it would leave it. */
+/* RETURN: true once only one player (or none) remains. */
+bool game_play_out(game_t *game, unsigned long limit)
+{
+    int i;
+    unsigned long moves;
+    unsigned long start = game->tick;
+    /* Most moves anyone can make before the limit, and how many ticks the game is sure to last. */
+    unsigned long last = limit == 0 ? ULONG_MAX : limit > start ? limit - start : 0;
+    unsigned long lasts = 0;
+    /* Player still in play that has made lasts moves, if any. */
+    int leader = -1;
+    bool led, chased;
+
+    for (i=0; i < game->num_players; i++)
+    {
+        for (moves=0; moves < lasts && !game->players[i].is_out; moves++)
+        {
+            play_step(game, i, start + moves);
+        }
+        if (game->players[i].is_out)
+        {
+            continue;
+        }
+        if (leader < 0)
+        {
+            leader = i;
+            continue;
+        }
+        while (lasts < last)
+        {
+            led = play_step(game, leader, start + lasts);
+            chased = play_step(game, i, start + lasts);
+            lasts++;
+            if (!led || !chased)
+            {
+                leader = led ? leader : chased ? i : -1;
+                break;
+            }
+        }
+    }
+    game->tick = start + lasts;
+
+    if (game->verify > 0)
+    {
+        assert(game->hash == game_rehash(game));
+    }
+    return game->num_out >= (game->num_players - 1);
+}
+
+/* Advance the game one tick. */
+/* RETURN: true once only one player (or none) remains. */
+bool game_tick(game_t *game)
+{
+    switch (game->gamemode)
+    {
+        case WORM:
+            return tick_body(game, WORM);
+        case DECAY:
+            return tick_body(game, DECAY);
+        default:
+            return tick_body(game, CLASSIC);
+    }
+}
+
+/* Copy everything the renderer needs into frame; its buffers must already fit the map. */
+void game_snapshot(const game_t *game, frame_t *frame)
+{
+    int i;
+
+    /* Frames only have room for a game's players, not an arena's. */
+    assert(game->num_players <= MAX_PLS);
+    frame->tick = game->tick;
+    frame->width = game->map.width;
+    frame->height = game->map.height;
+    memcpy(frame->cells, game->screen, game->map.width * game->map.height * sizeof(cell_t));
+
+    frame->num_pls = game->num_players;
+    for (i=0; i < game->num_players; i++)
+    {
+        frame->names[i] = game->players[i].name;
+        frame->scores[i] = game->players[i].score;
+        frame->is_out[i] = game->players[i].is_out;
+    }
+}
+
+void cleanup_game(game_t *game)
+{
+    int i;
+    /* To traverse player linked lists. */
+    struct player_node *next_node;
+    struct player_node *temp_node;
+
+    /* Free data structures. */
+    free(game->map.base);
+    free(game->map.pl_col);
+    free(game->map.expires);
+    free(game->screen);
+    free(game->expiring);
+    free(game->num_expiring);
+    for (i=0; i < game->num_players; i++)
+    {
+        /* Prime loop with root. */
+        next_node = game->players[i].root->next;
+        /* Free up root and then the rest of the nodes. */
+        free(game->players[i].root);
+        while (next_node != NULL)
+        {
+            /* Save reference to next node. */
+            temp_node = next_node->next;
+            /* Free current node. */
+            free(next_node);
+            /* Restore reference to next node. */
+            next_node = temp_node;
+        }
+    }
+    free(game->players);
+}
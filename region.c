@@ -0,0 +1,446 @@
+/*
+ * region.c
+ * Keeps track of which free tiles are connected to which as players wall the
+ * map off, so we can tell when every player is sealed into a pocket of their
+ * own. From then on nobody can get in anybody's way and the result depends
+ * only on how well each player fills their pocket.
+ *
+ * Only CLASSIC can be tracked: tiles there only ever fill up. Every free tile
+ * carries a region label. Filling a tile can only split its region, never
+ * join two. Free neighbours that are joined through a free corner tile next to
+ * it stay joined, so that is checked first. Runs of them that are left apart
+ * can only end up cut off from each other if the new tile closes a loop of
+ * filled tiles, that is if the filled tiles between two runs already touch
+ * each other further off. Filled tiles are kept in groups of touching tiles
+ * (corners count) to tell. Only if there is a loop is one search started from
+ * each run, and they take turns expanding a tile at a time. Searches that meet
+ * belong to the same part. Once all but one part have run out of tiles, those
+ * parts are closed off and are given new labels, while the part still going
+ * keeps the old one. So a split costs about as much as the smaller side, and
+ * anything else costs a look at eight tiles.
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "drtron.h"
+
+/* Start a region of size tiles. */
+/* RETURN: its label. */
+static int new_label(regions_t *regions, int size)
+{
+    if (regions->num_labels == regions->cap_labels)
+    {
+        regions->cap_labels *= 2;
+        regions->sizes = (int *) realloc(regions->sizes, regions->cap_labels * sizeof(int));
+        regions->claimed_by = (int *) realloc(regions->claimed_by, regions->cap_labels * sizeof(int));
+        regions->claimed_at = (unsigned *) realloc(regions->claimed_at, regions->cap_labels * sizeof(unsigned));
+        memset(regions->claimed_at + regions->num_labels, 0, (regions->cap_labels - regions->num_labels) * sizeof(unsigned));
+    }
+    regions->sizes[regions->num_labels] = size;
+    return regions->num_labels++;
+}
+
+/* Add pos to the tiles search s has found. */
+static void found(regions_t *regions, int s, int pos)
+{
+    if (regions->num_found[s] == regions->cap_found[s])
+    {
+        regions->cap_found[s] *= 2;
+        regions->found[s] = (int *) realloc(regions->found[s], regions->cap_found[s] * sizeof(int));
+    }
+    regions->found[s][regions->num_found[s]++] = pos;
+    regions->mark[pos] = regions->gen * 4 + s;
+}
+
+/* A tile of the group of filled tiles pos is in. */
+static int group_of(int *group, int pos)
+{
+    while (group[pos] != pos)
+    {
+        group[pos] = group[group[pos]];
+        pos = group[pos];
+    }
+    return pos;
+}
+
+/* Put the filled tiles a and b in the same group. */
+static void join(int *group, int a, int b)
+{
+    group[group_of(group, a)] = group_of(group, b);
+}
+
+/* RETURN: true on the tick a headless game should start tracking, if it is big enough to be worth it. */
+bool regions_due(const game_t *game)
+{
+    return game->tick == TRACK_AFTER && (long) game->map.width * game->map.height >= TRACK_TILES;
+}
+
+/* Label every free tile of game from scratch. */
+/* RETURN: false unless game is CLASSIC, the only mode where tiles never free up again. */
+bool regions_init(regions_t *regions, const game_t *game)
+{
+    int i, s, pos, next, label;
+    int size = game->map.width * game->map.height;
+    const int steps[] = { -game->map.width, game->map.width, -1, 1 };
+    /* Right, down, down and right, down and left. */
+    const int groupings[] = { 1, game->map.width, game->map.width + 1, game->map.width - 1 };
+
+    if (game->gamemode != CLASSIC)
+    {
+        return false;
+    }
+
+    regions->width = game->map.width;
+    regions->label = (int *) malloc(size * sizeof(int));
+    regions->group = (int *) malloc(size * sizeof(int));
+    regions->mark = (unsigned *) calloc(size, sizeof(unsigned));
+    regions->gen = 0;
+    regions->num_labels = 0;
+    regions->cap_labels = 16;
+    regions->sizes = (int *) malloc(regions->cap_labels * sizeof(int));
+    regions->claimed_by = (int *) malloc(regions->cap_labels * sizeof(int));
+    regions->claimed_at = (unsigned *) calloc(regions->cap_labels, sizeof(unsigned));
+    regions->check = 0;
+    for (s=0; s < 4; s++)
+    {
+        regions->cap_found[s] = 64;
+        regions->found[s] = (int *) malloc(regions->cap_found[s] * sizeof(int));
+    }
+
+    /* -1 is filled, -2 is free but not labelled yet. */
+    for (i=0; i < size; i++)
+    {
+        regions->label[i] = game->map.pl_col[i] ? -1 : -2;
+    }
+    /* Heads only fill their first tile once they leave it. */
+    for (i=0; i < game->num_players; i++)
+    {
+        regions->label[game->players[i].root->pos] = -1;
+    }
+    /* Group filled tiles with those touching them to the right and below; the rest of the ring is done from the other side. */
+    for (i=0; i < size; i++)
+    {
+        regions->group[i] = i;
+    }
+    for (i=0; i < size; i++)
+    {
+        if (regions->label[i] != -1)
+        {
+            continue;
+        }
+        for (s=0; s < 4; s++)
+        {
+            next = i + groupings[s];
+            /* Off the end of a row these wrap round, but only ever from wall to wall. */
+            if (next < size && regions->label[next] == -1)
+            {
+                join(regions->group, i, next);
+            }
+        }
+    }
+    /* Flood each unlabelled tile's region, using the first search's list as a stack. */
+    for (i=0; i < size; i++)
+    {
+        if (regions->label[i] != -2)
+        {
+            continue;
+        }
+        label = new_label(regions, 0);
+        regions->label[i] = label;
+        regions->num_found[0] = 0;
+        found(regions, 0, i);
+        while (regions->num_found[0] > 0)
+        {
+            pos = regions->found[0][--regions->num_found[0]];
+            regions->sizes[label]++;
+            for (s=0; s < 4; s++)
+            {
+                next = pos + steps[s];
+                if (regions->label[next] == -2)
+                {
+                    regions->label[next] = label;
+                    found(regions, 0, next);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* Root of search s among the searches that have met. */
+static int part_of(const int *parts, int s)
+{
+    while (parts[s] != s)
+    {
+        s = parts[s];
+    }
+    return s;
+}
+
+/* Fill pos, splitting its region if that cut it in two (or more). */
+static void fill(regions_t *regions, int pos)
+{
+    int s, t, k, d, next, other, mine, label;
+    int old = regions->label[pos];
+    const int steps[] = { -regions->width, regions->width, -1, 1 };
+    /* Tiles around pos clockwise from above, and which of them are free. */
+    const int ring[] = { -regions->width, -regions->width + 1, 1, regions->width + 1,
+                         regions->width, regions->width - 1, -1, -regions->width - 1 };
+    bool free_at[8];
+    /* Which of them a search starts from, and the group of the filled tiles after each. */
+    bool seed_at[8] = { false };
+    int gaps[4];
+    bool looped;
+    /* Number of searches, which part each belongs to, and how far through its tiles each is. */
+    int num = 0;
+    int parts[4], done[4];
+    /* Parts found so far, how many still have tiles to expand, and the one keeping the old label. */
+    int num_parts, num_going, keep;
+    bool changed = false;
+    int sizes[4];
+
+    if (old < 0)
+    {
+        return;
+    }
+    regions->label[pos] = -1;
+    regions->sizes[old]--;
+
+    /* Free neighbours joined through a free corner tile are joined already; search from one tile of each run. */
+    for (d=0; d < 8; d++)
+    {
+        free_at[d] = regions->label[pos + ring[d]] >= 0;
+    }
+    regions->gen++;
+    for (d=0; d < 8; d += 2)
+    {
+        seed_at[d] = free_at[d] && !(free_at[(d + 6) % 8] && free_at[(d + 7) % 8]);
+        if (seed_at[d])
+        {
+            parts[num] = num;
+            done[num] = 0;
+            regions->num_found[num] = 0;
+            found(regions, num, pos + ring[d]);
+            num++;
+        }
+    }
+    /* The filled tiles between one run and the next all touch, so each gap between runs is in one group. */
+    /* Two gaps in the same group mean pos closes a loop, which is the only way runs get cut off from each other. */
+    looped = false;
+    if (num > 1)
+    {
+        for (d=0; !seed_at[d]; d++)
+            ;
+        for (k=1, s=0; k < 8; k++)
+        {
+            t = (d + k) % 8;
+            if (seed_at[t])
+            {
+                s++;
+            }
+            else if (!free_at[t])
+            {
+                gaps[s] = group_of(regions->group, pos + ring[t]);
+            }
+        }
+        for (s=0; s < num; s++)
+        {
+            for (k=s + 1; k < num; k++)
+            {
+                looped = looped || gaps[s] == gaps[k];
+            }
+        }
+    }
+    for (d=0; d < 8; d++)
+    {
+        if (!free_at[d])
+        {
+            join(regions->group, pos, pos + ring[d]);
+        }
+    }
+    /* One run (or a ring of them all the way round) can't have been cut, and nor can runs without a loop. */
+    if (!looped)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        /* Each search takes a turn. */
+        for (s=0; s < num; s++)
+        {
+            if (done[s] == regions->num_found[s])
+            {
+                continue;
+            }
+            t = regions->found[s][done[s]++];
+            for (d=0; d < 4; d++)
+            {
+                next = t + steps[d];
+                if (regions->label[next] < 0)
+                {
+                    continue;
+                }
+                if (regions->mark[next] / 4 != regions->gen)
+                {
+                    found(regions, s, next);
+                    continue;
+                }
+                /* Been here this time round: if another part got here first, it is the same part. */
+                other = part_of(parts, regions->mark[next] % 4);
+                mine = part_of(parts, s);
+                if (other != mine)
+                {
+                    parts[other] = mine;
+                    changed = true;
+                }
+            }
+            changed = changed || done[s] == regions->num_found[s];
+        }
+
+        /* Nothing to decide until parts join or a search runs dry. */
+        if (!changed)
+        {
+            continue;
+        }
+        changed = false;
+        num_parts = num_going = 0;
+        keep = -1;
+        for (s=0; s < num; s++)
+        {
+            if (part_of(parts, s) != s)
+            {
+                continue;
+            }
+            num_parts++;
+            for (k=0; k < num; k++)
+            {
+                if (part_of(parts, k) == s && done[k] < regions->num_found[k])
+                {
+                    num_going++;
+                    keep = s;
+                    break;
+                }
+            }
+        }
+        if (num_parts == 1)
+        {
+            return;
+        }
+        if (num_going <= 1)
+        {
+            break;
+        }
+    }
+
+    /* Every part but keep is closed off; keep is what is left of the old region. */
+    for (s=0; s < num; s++)
+    {
+        sizes[s] = 0;
+    }
+    for (s=0; s < num; s++)
+    {
+        sizes[part_of(parts, s)] += regions->num_found[s];
+    }
+    if (keep < 0)
+    {
+        /* All closed at once, so relabel all but the biggest. */
+        for (s=0; s < num; s++)
+        {
+            if (part_of(parts, s) == s && (keep < 0 || sizes[s] > sizes[keep]))
+            {
+                keep = s;
+            }
+        }
+    }
+    for (s=0; s < num; s++)
+    {
+        if (part_of(parts, s) != s || s == keep)
+        {
+            continue;
+        }
+        label = new_label(regions, sizes[s]);
+        regions->sizes[old] -= sizes[s];
+        for (k=0; k < num; k++)
+        {
+            if (part_of(parts, k) != s)
+            {
+                continue;
+            }
+            for (t=0; t < regions->num_found[k]; t++)
+            {
+                regions->label[regions->found[k][t]] = label;
+            }
+        }
+    }
+}
+
+/* Catch up with a tick: in CLASSIC every player in play has just filled the tile its head is on. */
+void regions_update(regions_t *regions, const game_t *game)
+{
+    int i;
+
+    for (i=0; i < game->num_players; i++)
+    {
+        if (!game->players[i].is_out)
+        {
+            fill(regions, game->players[i].root->pos);
+        }
+    }
+}
+
+/* RETURN: true if no two players in play can reach the same free tile, and at least two still have somewhere to go. */
+/* A game where all but one are boxed in with no room at all is about to end anyway, so that is not sealed. */
+bool regions_sealed(regions_t *regions, const game_t *game)
+{
+    int i, d, label;
+    int num_roomy = 0;
+    bool roomy;
+    const int steps[] = { -regions->width, regions->width, -1, 1 };
+
+    regions->check++;
+    for (i=0; i < game->num_players; i++)
+    {
+        if (game->players[i].is_out)
+        {
+            continue;
+        }
+        roomy = false;
+        for (d=0; d < 4; d++)
+        {
+            label = regions->label[game->players[i].root->pos + steps[d]];
+            if (label < 0)
+            {
+                continue;
+            }
+            if (regions->claimed_at[label] == regions->check && regions->claimed_by[label] != i)
+            {
+                return false;
+            }
+            regions->claimed_at[label] = regions->check;
+            regions->claimed_by[label] = i;
+            roomy = true;
+        }
+        num_roomy += roomy;
+    }
+    return num_roomy >= 2;
+}
+
+void regions_free(regions_t *regions)
+{
+    int s;
+
+    free(regions->label);
+    free(regions->group);
+    free(regions->mark);
+    free(regions->sizes);
+    free(regions->claimed_by);
+    free(regions->claimed_at);
+    for (s=0; s < 4; s++)
+    {
+        free(regions->found[s]);
+    }
+}
@@ -0,0 +1,249 @@
+/*
+ * render.c
+ * Backends that put frames on the terminal. The curses one lets ncurses work
+ * out what changed; the ansi one diffs against the last frame itself and sends
+ * all of it with a single write().
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <curses.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drtron.h"
+
+/* Foreground of every color pair we use; the background is always black. */
+/* Curses color numbers are the same as ANSI ones, so both backends share this. */
+static const short pair_fg[] = {
+    /* Players 1-4. */
+    [1] = COLOR_YELLOW,
+    [2] = COLOR_GREEN,
+    [3] = COLOR_RED,
+    [4] = COLOR_BLUE,
+    /* Other tiles. */
+    [FLOOR] = COLOR_WHITE,
+    [WALL] = COLOR_WHITE,
+    [ADDONE] = COLOR_MAGENTA,
+};
+
+/* Set up the curses color pairs of the game. */
+/* TODO: Allow player to customize their color pair. */
+void init_colors(void)
+{
+    int i;
+
+    for (i=1; i < sizeof(pair_fg) / sizeof(pair_fg[0]); i++)
+    {
+        if (pair_fg[i] != COLOR_BLACK)
+        {
+            init_pair(i, pair_fg[i], COLOR_BLACK);
+        }
+    }
+}
+
+/* Look a backend up by name. */
+/* RETURN: NULL if there is no such backend. */
+const render_t *render_find(const char *name)
+{
+    int i;
+
+    for (i=0; renderers[i] != NULL; i++)
+    {
+        if (strcmp(renderers[i]->name, name) == 0)
+        {
+            return renderers[i];
+        }
+    }
+    return NULL;
+}
+
+// CURSES //
+
+/* Put frame into stdscr without refreshing. */
+static void curses_paint(const frame_t *frame)
+{
+    int i;
+
+    /* Move cursor back to top left. */
+    move(0,0);
+    /* Print the map with players already drawn on it. */
+    for (i=0; i < frame->width * frame->height; i++)
+    {
+        /* Drawing. */
+        addch(frame->cells[i].tex | COLOR_PAIR(frame->cells[i].pair));
+        if ((i + 1) % frame->width == 0)
+        {
+            addch('\n');
+        }
+    }
+}
+
+static void curses_begin(int fd, int width, int height)
+{
+    /* Curses already knows where it is drawing to. */
+}
+
+void draw_map(const frame_t *frame)
+{
+    curses_paint(frame);
+    /* Put it onto the screen. */
+    refresh();
+}
+
+/* Leave frame in stdscr and staged for the next update, so getch() does not paint it over a menu. */
+static void curses_suspend(const frame_t *frame)
+{
+    curses_paint(frame);
+    wnoutrefresh(stdscr);
+}
+
+static void curses_end(void)
+{
+}
+
+const render_t render_curses = {
+    "curses",
+    curses_begin,
+    draw_map,
+    curses_suspend,
+    curses_end,
+};
+
+// ANSI //
+
+/* Where frames go. */
+static int ansi_fd;
+static int ansi_width, ansi_height;
+/* Last frame we sent, to diff against. */
+static cell_t *ansi_prev;
+/* Is ansi_prev what is actually on the terminal? */
+static bool ansi_valid;
+/* Escape sequences of the frame being built; reused from frame to frame. */
+static char *ansi_buf;
+static size_t ansi_len;
+
+/* Append a string to the frame. */
+static void ansi_puts(const char *str)
+{
+    while (*str != '\0')
+    {
+        ansi_buf[ansi_len++] = *str++;
+    }
+}
+
+/* Append a decimal number to the frame. */
+static void ansi_putnum(int num)
+{
+    char digits[12];
+    int n = 0;
+
+    do
+    {
+        digits[n++] = '0' + num % 10;
+        num /= 10;
+    } while (num > 0);
+    while (n > 0)
+    {
+        ansi_buf[ansi_len++] = digits[--n];
+    }
+}
+
+/* Send everything built so far. */
+static void ansi_flush(void)
+{
+    size_t done = 0;
+    ssize_t wrote;
+
+    /* One write() unless the terminal takes it in pieces. */
+    while (done < ansi_len)
+    {
+        wrote = write(ansi_fd, ansi_buf + done, ansi_len - done);
+        if (wrote < 0 && errno != EINTR)
+        {
+            break;
+        }
+        done += wrote > 0 ? wrote : 0;
+    }
+    ansi_len = 0;
+}
+
+static void ansi_begin(int fd, int width, int height)
+{
+    ansi_fd = fd;
+    ansi_width = width;
+    ansi_height = height;
+    ansi_prev = (cell_t *) malloc(width * height * sizeof(cell_t));
+    ansi_valid = false;
+    /* Worst case every cell needs a cursor move and a color change: "\e[rrrrr;ccccc" "H" "\e[3c;40m" "x". */
+    ansi_buf = (char *) malloc(width * height * 24 + 64);
+    ansi_len = 0;
+}
+
+/* Send the cells of frame that differ from what is on the terminal. */
+static void ansi_draw(const frame_t *frame)
+{
+    int i;
+    /* Where the terminal's cursor is, as a map position; -1 if unknown. */
+    int cursor = -1;
+    /* Color pair the terminal is set to; -1 if unknown. */
+    int pair = -1;
+
+    for (i=0; i < ansi_width * ansi_height; i++)
+    {
+        if (ansi_valid && frame->cells[i].tex == ansi_prev[i].tex && frame->cells[i].pair == ansi_prev[i].pair)
+        {
+            continue;
+        }
+        if (i != cursor)
+        {
+            ansi_puts("\033[");
+            ansi_putnum(i / ansi_width + 1);
+            ansi_puts(";");
+            ansi_putnum(i % ansi_width + 1);
+            ansi_puts("H");
+        }
+        if (frame->cells[i].pair != pair)
+        {
+            pair = frame->cells[i].pair;
+            ansi_puts("\033[3");
+            ansi_putnum(pair_fg[pair]);
+            ansi_puts(";40m");
+        }
+        ansi_buf[ansi_len++] = frame->cells[i].tex;
+        ansi_prev[i] = frame->cells[i];
+        /* Wrapping onto the next row is not something we rely on. */
+        cursor = (i + 1) % ansi_width == 0 ? -1 : i + 1;
+    }
+    ansi_valid = true;
+    ansi_flush();
+}
+
+/* Curses has no idea what we drew, so give it the frame and have it repaint everything. */
+static void ansi_suspend(const frame_t *frame)
+{
+    ansi_puts("\033[0m");
+    ansi_flush();
+    curses_suspend(frame);
+    clearok(curscr, TRUE);
+    /* Whatever curses draws over us invalidates our copy. */
+    ansi_valid = false;
+}
+
+static void ansi_end(void)
+{
+    free(ansi_prev);
+    free(ansi_buf);
+}
+
+const render_t render_ansi = {
+    "ansi",
+    ansi_begin,
+    ansi_draw,
+    ansi_suspend,
+    ansi_end,
+};
+
+const render_t *const renderers[] = { &render_curses, &render_ansi, NULL };
@@ -0,0 +1,143 @@
+/*
+ * replay.c
+ * Replay logs: the seed and shape of each game, the keys applied before each
+ * tick and the state hash after it. Checking a log re-runs every game headless
+ * and reports the first tick whose hash differs, which catches any change that
+ * makes the simulation behave differently.
+ *
+ * Format, one record per line:
+ *  drtron-replay <seed> <gamemode> <num_pls> <width> <height> <decay>   (starts a game)
+ *  k <key>                                                      (applied before the next tick)
+ *  t <player> <way>                                             (bot turn, after the keys)
+ *  <tick> <hash>                                                (state after that tick)
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drtron.h"
+
+/* Start a new game in the log. */
+void replay_header(FILE *log, const game_t *game)
+{
+    fprintf(log, "drtron-replay %u %d %d %d %d %d\n", game->seed, game->gamemode,
+            game->num_players, game->map.width, game->map.height, game->decay);
+}
+
+/* Record a key handed to game_steer(). */
+void replay_key(FILE *log, int key)
+{
+    fprintf(log, "k %d\n", key);
+}
+
+/* Record a turn handed to game_turn() by a bot. */
+void replay_turn(FILE *log, int pl, int way)
+{
+    fprintf(log, "t %d %d\n", pl, way);
+}
+
+/* Record the state after a tick. */
+void replay_tick(FILE *log, const game_t *game)
+{
+    fprintf(log, "%lu %016" PRIx64 "\n", game->tick, game->hash);
+}
+
+/* Re-run every game in the log at path, verifying the hash every verify ticks. */
+/* RETURN: EXIT_SUCCESS if every hash matched. */
+int replay_check(const char *path, int verify)
+{
+    FILE *log;
+    /* One line of the log. */
+    char line[128];
+    /* Settings rebuilt from a header line, and the fields it has. */
+    settings_t settings;
+    unsigned seed;
+    int gamemode, num_pls, width, height, decay;
+    /* Game being re-run, if in_game. */
+    game_t game;
+    bool in_game = false;
+    /* Fields of a record. */
+    int key, pl, way;
+    unsigned long tick;
+    uint64_t hash;
+    /* Totals for the summary. */
+    int games = 0;
+    unsigned long ticks = 0;
+    int ret = EXIT_SUCCESS;
+
+    log = fopen(path, "r");
+    if (log == NULL)
+    {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    default_settings(&settings, CLASSIC, 0);
+
+    while (ret == EXIT_SUCCESS && fgets(line, sizeof(line), log) != NULL)
+    {
+        /* Logs from before DECAY have no decay field. */
+        decay = DEF_DECAY;
+        if (sscanf(line, "drtron-replay %u %d %d %d %d %d", &seed, &gamemode, &num_pls, &width, &height, &decay) >= 5)
+        {
+            if (in_game)
+            {
+                cleanup_game(&game);
+            }
+            /* Names only change how players look, so leave them as defaults. */
+            cleanup_settings(&settings);
+            default_settings(&settings, gamemode, num_pls);
+            settings.seed = seed;
+            settings.width = width;
+            settings.height = height;
+            settings.decay = decay;
+            settings.verify = verify;
+            in_game = game_init(&game, &settings, settings.width, settings.height);
+            if (!in_game)
+            {
+                ret = EXIT_FAILURE;
+            }
+            games++;
+        }
+        else if (sscanf(line, "k %d", &key) == 1 && in_game)
+        {
+            game_steer(&game, key);
+        }
+        else if (sscanf(line, "t %d %d", &pl, &way) == 2 && in_game && pl >= 0 && pl < game.num_players)
+        {
+            game_turn(&game, pl, way);
+        }
+        else if (sscanf(line, "%lu %" SCNx64, &tick, &hash) == 2 && in_game)
+        {
+            game_tick(&game);
+            ticks++;
+            if (game.tick != tick || game.hash != hash)
+            {
+                fprintf(stderr, "%s: game %d diverges at tick %lu: logged %016" PRIx64 ", got %016" PRIx64 "\n",
+                        path, games, tick, hash, game.hash);
+                ret = EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s: bad record: %s", path, line);
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    if (in_game)
+    {
+        cleanup_game(&game);
+    }
+    cleanup_settings(&settings);
+    fclose(log);
+
+    if (ret == EXIT_SUCCESS)
+    {
+        printf("%s: %d games, %lu ticks, all hashes match\n", path, games, ticks);
+    }
+    return ret;
+}
@@ -0,0 +1,454 @@
+/*
+ * shard.c
+ * Sharded simulation for headless arenas: the map is cut into horizontal
+ * strips and each strip is ticked by its own worker, with the calling thread
+ * working the first strip. A tick comes out exactly as game_tick() would have
+ * left it, down to the hash.
+ *
+ * game_tick() moves players one after another, so a player may only move onto
+ * a tile that was free when the tick began and that no earlier player has
+ * moved onto since. In CLASSIC and DECAY nothing a move frees up can be moved
+ * onto in the same tick, so that is the whole story, and it splits into:
+ *  1. Each worker checks its players' targets against the map as it stood at
+ *     the start of the tick, knocks out those that are blocked and sends the
+ *     rest as claims to whichever strip owns the target tile.
+ *  2. Each worker finds the lowest numbered player claiming each of its tiles.
+ *  3. That player moves (and becomes the strip's); the others are knocked out.
+ *  4. DECAY only: the workers split up sweeping the trail expiring this tick.
+ * with a barrier between phases. A target is at most one row past the edge of
+ * a strip, so the edge rows of the neighbours are the ghost rows: read in
+ * place during phase 1, while nobody writes the map, and claims on them are
+ * handed to their owner rather than resolved on a copy.
+ *
+ * Moves are made on a private copy of the game header. Everything it points
+ * to is shared, and every tile or player a worker writes is one nobody else
+ * touches that phase. The hash, num_out and expiry counts are private, and are
+ * merged once the tick is done (hashing is xor, so order doesn't matter).
+ * WORM can't be sharded like this: a tail moving off a tile frees it for later
+ * players in the same tick, so it stays on game_tick().
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drtron.h"
+
+/* Tile player pl is heading for. */
+static int target(const game_t *game, int pl)
+{
+    return game->players[pl].root->pos + game->players[pl].dir;
+}
+
+/* Strip s's part of one tick; the barrier separates the phases described above. */
+static void strip_tick(shards_t *shards, int s)
+{
+    int i, k, side, t;
+    game_t *game = shards->game;
+    strip_t *strip = &shards->strips[s];
+    game_t *local = &strip->local;
+    int width = game->map.width;
+    /* Claims this strip sends to the strip above, itself and the strip below, for short. */
+    strip_t *to[3] = {
+        s > 0 ? &shards->strips[s - 1] : NULL,
+        strip,
+        s < shards->num_strips - 1 ? &shards->strips[s + 1] : NULL,
+    };
+    int fill = (game->tick + game->decay) % (game->decay + 1);
+    int offset, sweep;
+    int *swap;
+
+    *local = *game;
+    local->hash = 0;
+    local->num_out = 0;
+    local->num_expiring = strip->num_expiring;
+    if (game->gamemode == DECAY)
+    {
+        strip->num_expiring[fill] = 0;
+    }
+
+    /* Phase 1; the strip above files our claims as coming from below, and vice versa. */
+    for (side=0; side < 3; side++)
+    {
+        if (to[side] != NULL)
+        {
+            to[side]->num_claims[2 - side] = 0;
+        }
+    }
+    for (k=0; k < strip->num_pls; k++)
+    {
+        i = strip->pls[k];
+        if (shards->autopilot)
+        {
+            game_autopilot(local, i);
+        }
+        t = target(game, i);
+        if (game_blocked(local, t))
+        {
+            game_knock_out(local, i);
+            continue;
+        }
+        side = t / width < strip->row_from ? 0 : t / width >= strip->row_to ? 2 : 1;
+        to[side]->claims[2 - side][to[side]->num_claims[2 - side]++] = i;
+    }
+    pthread_barrier_wait(&shards->barrier);
+
+    /* Phase 2: the lowest numbered claimant would have got there first. */
+    strip->num_won = 0;
+    for (side=0; side < 3; side++)
+    {
+        for (k=0; k < strip->num_claims[side]; k++)
+        {
+            i = strip->claims[side][k];
+            t = target(game, i);
+            if (shards->claim[t] < 0 || i < shards->claim[t])
+            {
+                if (shards->claim[t] < 0)
+                {
+                    strip->num_won++;
+                }
+                shards->claim[t] = i;
+            }
+        }
+    }
+    pthread_barrier_wait(&shards->barrier);
+
+    /* Phase 3; trail laid by this strip goes after the earlier strips' in the expiry bucket. */
+    offset = 0;
+    for (k=0; k < s; k++)
+    {
+        offset += shards->strips[k].num_won;
+    }
+    local->expiring = game->expiring == NULL ? NULL : game->expiring + offset;
+    strip->num_pls = 0;
+    for (side=0; side < 3; side++)
+    {
+        for (k=0; k < strip->num_claims[side]; k++)
+        {
+            i = strip->claims[side][k];
+            if (shards->claim[target(game, i)] == i)
+            {
+                game_move(local, i);
+                strip->next_pls[strip->num_pls++] = i;
+            }
+            else
+            {
+                game_knock_out(local, i);
+            }
+        }
+    }
+    /* Only after every loser has seen who won. */
+    for (side=0; side < 3; side++)
+    {
+        for (k=0; k < strip->num_claims[side]; k++)
+        {
+            /* The winner has moved onto its target, so go by where it is now. */
+            i = strip->claims[side][k];
+            shards->claim[game->players[i].is_out ? target(game, i) : game->players[i].root->pos] = -1;
+        }
+    }
+    /* The players now heading from this strip are the ones to move next tick. */
+    swap = strip->pls;
+    strip->pls = strip->next_pls;
+    strip->next_pls = swap;
+
+    /* Phase 4. */
+    if (game->gamemode == DECAY)
+    {
+        pthread_barrier_wait(&shards->barrier);
+        local->expiring = game->expiring;
+        sweep = game->num_expiring[game->tick % (game->decay + 1)];
+        game_sweep(local, s * sweep / shards->num_strips, (s + 1) * sweep / shards->num_strips);
+    }
+}
+
+/* Body of a worker thread: one strip_tick() per tick until told to quit. */
+static void *strip_run(void *arg)
+{
+    strip_t *strip = arg;
+    shards_t *shards = strip->shards;
+
+    while (true)
+    {
+        pthread_barrier_wait(&shards->barrier);
+        if (shards->quit)
+        {
+            return NULL;
+        }
+        strip_tick(shards, strip->idx);
+        pthread_barrier_wait(&shards->barrier);
+    }
+}
+
+/* Free what shards_init() allocated for the strips. */
+static void free_strips(shards_t *shards)
+{
+    int s, i;
+
+    for (s=0; s < shards->num_strips; s++)
+    {
+        free(shards->strips[s].pls);
+        free(shards->strips[s].next_pls);
+        for (i=0; i < 3; i++)
+        {
+            free(shards->strips[s].claims[i]);
+        }
+        free(shards->strips[s].num_expiring);
+    }
+    free(shards->strips);
+    free(shards->claim);
+}
+
+/* Split game into num_strips strips (fewer if the map is too short) and start their workers. */
+/* RETURN: false for WORM, which has to be ticked in order, or if the strips could not be allocated. */
+bool shards_init(shards_t *shards, game_t *game, int num_strips, bool autopilot)
+{
+    int i, s, row;
+    int height = game->map.height;
+    int size = game->map.width * height;
+    strip_t *strip;
+    bool allocated = true;
+
+    if (game->gamemode == WORM)
+    {
+        return false;
+    }
+    if (num_strips > height)
+    {
+        num_strips = height;
+    }
+    if (num_strips < 1)
+    {
+        num_strips = 1;
+    }
+
+    shards->game = game;
+    shards->num_strips = num_strips;
+    shards->autopilot = autopilot;
+    shards->quit = false;
+    shards->claim = (int *) malloc((size_t) size * sizeof(int));
+    shards->strips = (strip_t *) calloc(num_strips, sizeof(strip_t));
+    if (shards->claim == NULL || shards->strips == NULL)
+    {
+        fprintf(stderr, "not enough memory for %d strips\n", num_strips);
+        free(shards->claim);
+        free(shards->strips);
+        return false;
+    }
+    for (i=0; i < size; i++)
+    {
+        shards->claim[i] = -1;
+    }
+    for (s=0; s < num_strips; s++)
+    {
+        strip = &shards->strips[s];
+        strip->shards = shards;
+        strip->idx = s;
+        strip->row_from = s * height / num_strips;
+        strip->row_to = (s + 1) * height / num_strips;
+        /* A strip could end up with every player, so size for that rather than count. */
+        strip->pls = (int *) malloc(game->num_players * sizeof(int));
+        strip->next_pls = (int *) malloc(game->num_players * sizeof(int));
+        for (i=0; i < 3; i++)
+        {
+            strip->claims[i] = (int *) malloc(game->num_players * sizeof(int));
+        }
+        strip->num_expiring = (int *) calloc((size_t) game->decay + 1, sizeof(int));
+        if (strip->pls == NULL || strip->next_pls == NULL || strip->claims[0] == NULL
+            || strip->claims[1] == NULL || strip->claims[2] == NULL || strip->num_expiring == NULL)
+        {
+            allocated = false;
+        }
+    }
+    if (!allocated)
+    {
+        fprintf(stderr, "not enough memory for %d strips\n", num_strips);
+        free_strips(shards);
+        return false;
+    }
+
+    for (i=0; i < game->num_players; i++)
+    {
+        if (!game->players[i].is_out)
+        {
+            row = game->players[i].root->pos / game->map.width;
+            strip = &shards->strips[row * num_strips / height];
+            /* Row boundaries round down, so the guess can be a strip out. */
+            while (row < strip->row_from)
+            {
+                strip--;
+            }
+            while (row >= strip->row_to)
+            {
+                strip++;
+            }
+            strip->pls[strip->num_pls++] = i;
+        }
+    }
+
+    pthread_barrier_init(&shards->barrier, NULL, num_strips);
+    for (s=1; s < num_strips; s++)
+    {
+        pthread_create(&shards->strips[s].thread, NULL, strip_run, &shards->strips[s]);
+    }
+    return true;
+}
+
+/* Advance the game one tick across all the workers. */
+/* RETURN: true once only one player (or none) remains. */
+bool shards_tick(shards_t *shards)
+{
+    int s;
+    game_t *game = shards->game;
+    int won = 0;
+
+    pthread_barrier_wait(&shards->barrier);
+    strip_tick(shards, 0);
+    pthread_barrier_wait(&shards->barrier);
+
+    for (s=0; s < shards->num_strips; s++)
+    {
+        game->hash ^= shards->strips[s].local.hash;
+        game->num_out += shards->strips[s].local.num_out;
+        won += shards->strips[s].num_won;
+    }
+    if (game->gamemode == DECAY)
+    {
+        game->num_expiring[(game->tick + game->decay) % (game->decay + 1)] = won;
+        game->num_expiring[game->tick % (game->decay + 1)] = 0;
+    }
+    return game_finish_tick(game);
+}
+
+/* Stop the workers and free the strips; the game is left as it is. */
+void shards_free(shards_t *shards)
+{
+    int s;
+
+    shards->quit = true;
+    pthread_barrier_wait(&shards->barrier);
+    for (s=0; s < shards->num_strips; s++)
+    {
+        if (s > 0)
+        {
+            pthread_join(shards->strips[s].thread, NULL);
+        }
+    }
+    pthread_barrier_destroy(&shards->barrier);
+    free_strips(shards);
+}
+
+/* Play one autopiloted arena game from settings on threads workers (0 for plain game_tick()) and report on it. */
+/* Once regions_due(), a CLASSIC arena keeps track of its regions, and once every player is sealed off the */
+/* pockets are played out one at a time instead of ticked. */
+/* Stops after max_ticks if that is not 0, as DECAY arenas may never end. RETURN: EXIT_SUCCESS if the arena could be set up. */
+int run_arena(settings_t *settings, int threads, unsigned long max_ticks)
+{
+    int i;
+    game_t game;
+    shards_t shards;
+    bool over = false;
+    struct timespec start, end;
+    double secs;
+    int winner = -1;
+    /* Free regions, while tracked; tick everyone was sealed off at, if they were. */
+    regions_t regions;
+    bool tracking = false;
+    unsigned long sealed_at = 0;
+
+    if (!game_init(&game, settings, settings->width, settings->height))
+    {
+        return EXIT_FAILURE;
+    }
+    if (threads > 0)
+    {
+        if (shards_init(&shards, &game, threads, true))
+        {
+            threads = shards.num_strips;
+        }
+        else
+        {
+            if (game.gamemode == WORM)
+            {
+                fprintf(stderr, "worm arenas can only run on one thread\n");
+            }
+            threads = 0;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!over && (max_ticks == 0 || game.tick < max_ticks))
+    {
+        if (threads > 0)
+        {
+            over = shards_tick(&shards);
+        }
+        else
+        {
+            for (i=0; i < game.num_players; i++)
+            {
+                game_autopilot(&game, i);
+            }
+            over = game_tick(&game);
+        }
+        if (tracking && !over)
+        {
+            regions_update(&regions, &game);
+        }
+        else if (!over && regions_due(&game))
+        {
+            tracking = regions_init(&regions, &game);
+        }
+        if (tracking && !over && regions_sealed(&regions, &game))
+        {
+            sealed_at = game.tick;
+            regions_free(&regions);
+            tracking = false;
+            over = game_play_out(&game, max_ticks);
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (tracking)
+    {
+        regions_free(&regions);
+    }
+    for (i=0; over && i < game.num_players; i++)
+    {
+        if (!game.players[i].is_out)
+        {
+            winner = i;
+        }
+    }
+    printf("%d players on %dx%d, %d threads: %lu ticks in %.2fs (%.0f ticks/s), hash %016" PRIx64 "\n",
+           game.num_players, game.map.width, game.map.height, threads, game.tick, secs, game.tick / secs, game.hash);
+    if (sealed_at > 0)
+    {
+        printf("everyone sealed off at tick %lu, played out pocket by pocket\n", sealed_at);
+    }
+    if (!over)
+    {
+        printf("%d players still in play\n", game.num_players - game.num_out);
+    }
+    else if (winner >= 0)
+    {
+        printf("player %d wins\n", winner + 1);
+    }
+    else
+    {
+        printf("nobody wins\n");
+    }
+
+    if (threads > 0)
+    {
+        shards_free(&shards);
+    }
+    cleanup_game(&game);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,293 @@
+/*
+ * sim.c
+ * Runs a game on its own thread so a slow terminal never delays a tick.
+ * Frames go out through a lock-free triple buffer and keys come in through
+ * a single producer, single consumer queue.
+ * Authors:
+ *  Scott Linder
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "drtron.h"
+
+/* Allocate all three frames of a triple buffer for a width x height map. */
+void tribuf_init(tribuf_t *buf, int width, int height)
+{
+    int i;
+
+    for (i=0; i < 3; i++)
+    {
+        buf->slots[i].cells = (cell_t *) malloc(width * height * sizeof(cell_t));
+        buf->slots[i].over = false;
+        buf->slots[i].sealed = false;
+    }
+    /* Nothing has been published yet, so middle starts out stale. */
+    buf->back = 0;
+    atomic_init(&buf->middle, 1);
+    buf->front = 2;
+}
+
+/* Frame the writer may fill; nobody else looks at it until it is published. */
+frame_t *tribuf_back(tribuf_t *buf)
+{
+    return &buf->slots[buf->back];
+}
+
+/* Hand the back frame to the reader and take whatever it left in the middle. */
+void tribuf_publish(tribuf_t *buf)
+{
+    int old = atomic_exchange_explicit(&buf->middle, buf->back | TRIBUF_FRESH, memory_order_acq_rel);
+    buf->back = old & ~TRIBUF_FRESH;
+}
+
+/* Take the newest published frame, dropping any the reader never got to. */
+/* RETURN: NULL if nothing new was published since the last call. */
+const frame_t *tribuf_latest(tribuf_t *buf)
+{
+    int old;
+
+    if (!(atomic_load_explicit(&buf->middle, memory_order_relaxed) & TRIBUF_FRESH))
+    {
+        return NULL;
+    }
+    old = atomic_exchange_explicit(&buf->middle, buf->front, memory_order_acq_rel);
+    buf->front = old & ~TRIBUF_FRESH;
+    return &buf->slots[buf->front];
+}
+
+/* Frame the reader currently holds, for redrawing it. */
+const frame_t *tribuf_front(tribuf_t *buf)
+{
+    return &buf->slots[buf->front];
+}
+
+void tribuf_free(tribuf_t *buf)
+{
+    int i;
+
+    for (i=0; i < 3; i++)
+    {
+        free(buf->slots[i].cells);
+    }
+}
+
+/* Queue a key for the consumer. */
+/* RETURN: false if the queue is full and the key was dropped. */
+bool keyq_push(keyq_t *q, int key)
+{
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&q->head, memory_order_acquire) == KEYQ_LEN)
+    {
+        return false;
+    }
+    q->keys[tail & (KEYQ_LEN - 1)] = key;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/* Take the oldest queued key. */
+/* RETURN: false if the queue is empty. */
+bool keyq_pop(keyq_t *q, int *key)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+    {
+        return false;
+    }
+    *key = q->keys[head & (KEYQ_LEN - 1)];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+/* Move an absolute deadline one tick further along. */
+static void next_deadline(struct timespec *when)
+{
+    when->tv_nsec += TICK_NS;
+    while (when->tv_nsec >= 1000000000L)
+    {
+        when->tv_nsec -= 1000000000L;
+        when->tv_sec++;
+    }
+}
+
+/* Block while the render thread has us paused. */
+static void park(sim_t *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    while (atomic_load(&sim->pause) && !atomic_load(&sim->quit))
+    {
+        pthread_cond_wait(&sim->wake, &sim->lock);
+    }
+    pthread_mutex_unlock(&sim->lock);
+}
+
+/* Body of the simulation thread. */
+static void *sim_run(void *arg)
+{
+    sim_t *sim = arg;
+    /* Key popped from the render thread, and a player the autopilot may turn and the way it was going. */
+    int i, key, way;
+    /* Has the game finished? */
+    bool over = false;
+    /* Regions of free tiles, until everyone is sealed off (only tracked in CLASSIC). */
+    regions_t regions;
+    bool tracking = regions_init(&regions, sim->game);
+    bool sealed = false;
+    /* When the next tick is due; absolute so lateness never accumulates. */
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (!over && !atomic_load(&sim->quit))
+    {
+        /* Apply all input queued since the last tick. */
+        while (keyq_pop(&sim->input, &key))
+        {
+            game_steer(sim->game, key);
+            if (sim->log != NULL)
+            {
+                replay_key(sim->log, key);
+            }
+        }
+        if (atomic_load(&sim->fast))
+        {
+            /* Log the autopilot's turns like any other so the replay still checks out. */
+            for (i=0; i < sim->game->num_players; i++)
+            {
+                way = game_heading(sim->game, i);
+                game_autopilot(sim->game, i);
+                if (sim->log != NULL && game_heading(sim->game, i) != way)
+                {
+                    replay_turn(sim->log, i, game_heading(sim->game, i));
+                }
+            }
+        }
+        /* Bots have had the whole tick to answer; only the late ones hold it up. */
+        else if (sim->bots != NULL)
+        {
+            bots_collect(sim->bots, sim->game, sim->log);
+        }
+
+        over = game_tick(sim->game);
+        if (sim->log != NULL)
+        {
+            replay_tick(sim->log, sim->game);
+        }
+        if (sim->bots != NULL)
+        {
+            bots_publish(sim->bots, sim->game);
+        }
+        /* Once sealed, always sealed: the tiles can only fill up. */
+        if (tracking)
+        {
+            regions_update(&regions, sim->game);
+            sealed = regions_sealed(&regions, sim->game);
+            if (sealed)
+            {
+                regions_free(&regions);
+                tracking = false;
+            }
+        }
+
+        /* Publish; if the renderer is behind it simply never sees the older frame. */
+        game_snapshot(sim->game, tribuf_back(&sim->frames));
+        tribuf_back(&sim->frames)->over = over;
+        tribuf_back(&sim->frames)->sealed = sealed;
+        tribuf_publish(&sim->frames);
+
+        /* Fast-forwarding runs flat out, but still stops for menus. */
+        if (!over && atomic_load(&sim->fast))
+        {
+            if (atomic_load(&sim->pause))
+            {
+                park(sim);
+            }
+        }
+        else if (!over)
+        {
+            next_deadline(&deadline);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+                ;
+            /* Time spent in a menu should not be made up for with a burst of ticks. */
+            if (atomic_load(&sim->pause))
+            {
+                park(sim);
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+            }
+        }
+    }
+    if (tracking)
+    {
+        regions_free(&regions);
+    }
+    return NULL;
+}
+
+/* Spin up a simulation thread for game, logging a replay to log and taking turns from bots if not NULL. */
+void sim_start(sim_t *sim, game_t *game, FILE *log, bots_t *bots)
+{
+    int i;
+
+    sim->game = game;
+    sim->log = log;
+    sim->bots = bots;
+    if (log != NULL)
+    {
+        replay_header(log, game);
+    }
+    tribuf_init(&sim->frames, game->map.width, game->map.height);
+    atomic_init(&sim->input.head, 0);
+    atomic_init(&sim->input.tail, 0);
+    atomic_init(&sim->pause, false);
+    atomic_init(&sim->quit, false);
+    atomic_init(&sim->fast, false);
+    pthread_mutex_init(&sim->lock, NULL);
+    pthread_cond_init(&sim->wake, NULL);
+
+    /* The renderer has something to draw before the first tick, even from the frame it holds. */
+    for (i=0; i < 3; i++)
+    {
+        game_snapshot(game, &sim->frames.slots[i]);
+    }
+    tribuf_publish(&sim->frames);
+
+    pthread_create(&sim->thread, NULL, sim_run, sim);
+}
+
+/* Hold the simulation at the next tick boundary. */
+void sim_pause(sim_t *sim)
+{
+    atomic_store(&sim->pause, true);
+}
+
+void sim_resume(sim_t *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    atomic_store(&sim->pause, false);
+    pthread_cond_signal(&sim->wake);
+    pthread_mutex_unlock(&sim->lock);
+}
+
+/* Hand every player to the autopilot and tick as fast as possible until the game is over. */
+void sim_fast_forward(sim_t *sim)
+{
+    atomic_store(&sim->fast, true);
+}
+
+/* Stop the simulation thread and wait for it; the game is ours again afterwards. */
+void sim_stop(sim_t *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    atomic_store(&sim->quit, true);
+    pthread_cond_signal(&sim->wake);
+    pthread_mutex_unlock(&sim->lock);
+
+    pthread_join(sim->thread, NULL);
+    tribuf_free(&sim->frames);
+    pthread_mutex_destroy(&sim->lock);
+    pthread_cond_destroy(&sim->wake);
+}
@@ -0,0 +1,113 @@
+/*
+ * zobrist.c
+ * 64-bit Zobrist keys for every piece of game state, and a from-scratch hash
+ * to check the incremental one that game_tick() keeps against.
+ * Keys are derived from their index with splitmix64 rather than kept in
+ * tables, so they cost no memory however big the map is.
+ * Authors:
+ *  Scott Linder
+ */
+
+#include "drtron.h"
+
+/* Kinds of key, so e.g. a cell and a head at the same position differ. */
+enum zobrist_kind {
+    Z_CELL,
+    Z_ADDONE,
+    Z_HEAD,
+    Z_DIR,
+    Z_PENDING,
+    Z_OUT,
+    Z_EXPIRY,
+};
+
+/* splitmix64 finalizer: a cheap, well distributed bijection. */
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* Kind and player get a whole word to themselves, so no player number can spill into the kind. */
+static uint64_t key(enum zobrist_kind kind, int pl, int val)
+{
+    return mix(mix(((uint64_t) kind << 32) | (uint32_t) pl) ^ (uint32_t) val);
+}
+
+/* Cell pos collides. */
+uint64_t zobrist_cell(int pos)
+{
+    return key(Z_CELL, 0, pos);
+}
+
+/* Cell pos still holds an ADDONE tile. */
+uint64_t zobrist_addone(int pos)
+{
+    return key(Z_ADDONE, 0, pos);
+}
+
+/* Player pl has its head at pos. */
+uint64_t zobrist_head(int pl, int pos)
+{
+    return key(Z_HEAD, pl, pos);
+}
+
+/* Player pl is heading in dir. */
+uint64_t zobrist_dir(int pl, int dir)
+{
+    return key(Z_DIR, pl, dir);
+}
+
+/* Player pl has pending nodes queued. */
+uint64_t zobrist_pending(int pl, int pending)
+{
+    return key(Z_PENDING, pl, pending);
+}
+
+/* Player pl is out of play. */
+uint64_t zobrist_out(int pl)
+{
+    return key(Z_OUT, pl, 0);
+}
+
+/* Trail at pos expires at tick. */
+uint64_t zobrist_expiry(int pos, unsigned long tick)
+{
+    return mix(key(Z_EXPIRY, 0, pos) + tick);
+}
+
+/* Hash the whole game the slow way. */
+uint64_t game_rehash(const game_t *game)
+{
+    int i;
+    uint64_t hash = 0;
+
+    for (i=0; i < game->map.width * game->map.height; i++)
+    {
+        if (game->map.pl_col[i])
+        {
+            hash ^= zobrist_cell(i);
+        }
+        if (game->map.base[i] == ADDONE)
+        {
+            hash ^= zobrist_addone(i);
+        }
+        if (game->map.expires != NULL && game->map.pl_col[i] && game->map.expires[i] != NEVER_EXPIRES)
+        {
+            hash ^= zobrist_expiry(i, game->map.expires[i]);
+        }
+    }
+    for (i=0; i < game->num_players; i++)
+    {
+        hash ^= zobrist_head(i, game->players[i].root->pos);
+        hash ^= zobrist_dir(i, game->players[i].dir);
+        hash ^= zobrist_pending(i, game->players[i].nodes_pending);
+        if (game->players[i].is_out)
+        {
+            hash ^= zobrist_out(i);
+        }
+    }
+    return hash;
+}